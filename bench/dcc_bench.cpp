@@ -0,0 +1,253 @@
+#include <codegen.hpp>
+#include <compiler.hpp>
+#include <lexer.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+typedef struct
+{
+  int contexts;
+  int branches;
+  int declares;
+  int calls;
+} GeneratorOptions;
+
+typedef struct
+{
+  double seconds;
+  long peakRssKb;
+} PhaseResult;
+
+enum Phase
+{
+  PHASE_LEX,
+  PHASE_PARSE,
+  PHASE_CODEGEN,
+  PHASE_EMIT,
+  PHASE_COUNT,
+};
+
+static const char *phaseNames[PHASE_COUNT] = {"lex", "parse", "codegen", "emit"};
+
+// Context names are mangled without digits, so indices are spelled with letters
+static std::string letters(int index)
+{
+  std::string res = "";
+  do
+  {
+    res.push_back('a' + index % 26);
+    index /= 26;
+  } while (index > 0);
+  return res;
+}
+
+static std::string generateProgram(GeneratorOptions &options)
+{
+  std::string src = "extern i32 printf str vararg;\n\n";
+
+  for (int i = 0; i < options.contexts; i++)
+  {
+    src += "context ctx" + letters(i) + " i32 a i32 b -> i32;\n";
+    for (int j = 0; j < options.declares; j++)
+    {
+      src += "  declare i32 v" + std::to_string(j) + ";\n";
+    }
+    for (int j = 0; j < options.declares; j++)
+    {
+      src += "  assign v" + std::to_string(j) + " = a + b * " + std::to_string(j + 1) + ";\n";
+    }
+
+    src += "  if a == 0;\n    assign v0 = b + 1;\n";
+    for (int j = 1; j < options.branches; j++)
+    {
+      src += "  elif a == " + std::to_string(j) + ";\n    assign v0 = v0 - " + std::to_string(j) + ";\n";
+    }
+    src += "  fi;\n";
+
+    for (int j = 1; j <= options.calls && i - j >= 0; j++)
+    {
+      src += "  ctx" + letters(i - j) + "(v0, b) -> v" + std::to_string(j % options.declares) + ";\n";
+    }
+    src += "  return v0;\ncontext;\n\n";
+  }
+
+  src += "context main i32 argc str* argv -> i32;\n  declare i32 r;\n";
+  src += "  ctx" + letters(options.contexts - 1) + "(argc, argc) -> r;\n";
+  src += "  printf(\"%d\\n\", r);\n  return 0;\ncontext;\n";
+  return src;
+}
+
+static double since(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Runs every phase up to the measured one in a fresh process, so the peak RSS belongs to that phase
+static PhaseResult runPhase(Phase phase, const std::string &source, Settings &settings)
+{
+  int fds[2];
+  if (pipe(fds) != 0)
+  {
+    perror("pipe");
+    exit(1);
+  }
+
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    close(fds[0]);
+    PhaseResult result = {0, 0};
+
+    auto start = std::chrono::steady_clock::now();
+    if (phase == PHASE_LEX)
+    {
+      Lexer lexer(source);
+      while (lexer.next().type != TokenType::END)
+      {
+      }
+      result.seconds = since(start);
+    }
+    else
+    {
+      // Tokens are pulled by the parser, so this phase includes lexing
+      Lexer lexer(source);
+      DCFile file = parseFile(lexer);
+      result.seconds = since(start);
+
+      if (phase >= PHASE_CODEGEN)
+      {
+        start = std::chrono::steady_clock::now();
+        DCModule module = compileModule(file, settings, {}, 0, file.contexts.size());
+        result.seconds = since(start);
+
+        if (phase >= PHASE_EMIT)
+        {
+          start = std::chrono::steady_clock::now();
+          optimizeModule(*module.module, settings);
+          emitFile(*module.module, settings, "/dev/null", llvm::CodeGenFileType::ObjectFile);
+          result.seconds = since(start);
+        }
+      }
+    }
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    result.peakRssKb = usage.ru_maxrss;
+    write(fds[1], &result, sizeof(result));
+    _exit(0);
+  }
+
+  close(fds[1]);
+  PhaseResult result = {0, 0};
+  if (read(fds[0], &result, sizeof(result)) != sizeof(result))
+  {
+    fprintf(stderr, "dcc_bench: %s phase failed\n", phaseNames[phase]);
+    exit(1);
+  }
+  close(fds[0]);
+  waitpid(pid, nullptr, 0);
+  return result;
+}
+
+int main(int argc, char **argv)
+{
+  GeneratorOptions options = {2000, 16, 8, 4};
+  int repeat = 3;
+  std::string dumpSource = "";
+
+  Settings settings;
+  settings.output_name = "bench";
+  settings.nostdlib = true;
+  settings.build_std = false;
+  settings.build_io = false;
+  settings.pic = true;
+  settings.compilation_level = CL_OBJ;
+  settings.opt_level = OL_O0;
+  settings.time_report = false;
+  settings.time_report_json = false;
+  settings.lto = false;
+  settings.profile_generate = false;
+  settings.profile_use = "";
+  settings.instrument_contexts = false;
+  settings.cache_stats = false;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    std::string value = i + 1 < argc ? argv[i + 1] : "";
+    if (arg == "--contexts")
+    {
+      options.contexts = std::stoi(value), i++;
+    }
+    else if (arg == "--branches")
+    {
+      options.branches = std::stoi(value), i++;
+    }
+    else if (arg == "--declares")
+    {
+      options.declares = std::stoi(value), i++;
+    }
+    else if (arg == "--calls")
+    {
+      options.calls = std::stoi(value), i++;
+    }
+    else if (arg == "--repeat")
+    {
+      repeat = std::stoi(value), i++;
+    }
+    else if (arg == "-O2")
+    {
+      settings.opt_level = OL_O2;
+    }
+    else if (arg == "--dump")
+    {
+      dumpSource = value, i++;
+    }
+    else
+    {
+      printf("Usage: dcc_bench [--contexts N] [--branches N] [--declares N] [--calls N] [--repeat N] [-O2] [--dump file.dc]\n");
+      return arg == "--help" ? 0 : 1;
+    }
+  }
+
+  if (options.declares < 1 || options.branches < 1 || options.contexts < 1)
+  {
+    printf("dcc_bench: --contexts, --branches and --declares need to be at least 1\n");
+    return 1;
+  }
+
+  std::string source = generateProgram(options);
+  long lines = std::count(source.begin(), source.end(), '\n');
+  if (!dumpSource.empty())
+  {
+    std::ofstream(dumpSource) << source;
+  }
+
+  printf("dcc_bench: %d contexts, %ld lines, %zu bytes, best of %d, %s lexer\n", options.contexts, lines, source.size(), repeat, Lexer::scanner());
+  printf("  %-8s %12s %14s %14s\n", "phase", "time (ms)", "lines/s", "peak rss (MB)");
+  for (int phase = 0; phase < PHASE_COUNT; phase++)
+  {
+    PhaseResult best = {0, 0};
+    for (int i = 0; i < repeat; i++)
+    {
+      PhaseResult result = runPhase((Phase)phase, source, settings);
+      if (i == 0 || result.seconds < best.seconds)
+      {
+        best.seconds = result.seconds;
+      }
+      if (result.peakRssKb > best.peakRssKb)
+      {
+        best.peakRssKb = result.peakRssKb;
+      }
+    }
+    printf("  %-8s %12.3f %14.0f %14.1f\n", phaseNames[phase], best.seconds * 1e3, lines / best.seconds, best.peakRssKb / 1024.0);
+  }
+  return 0;
+}
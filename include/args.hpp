@@ -4,21 +4,46 @@
 #include <string>
 #include <vector>
 
+#define DCC_VER "nightly"
+
 typedef enum
 {
   CL_IR,
   CL_ASM,
   CL_OBJ,
   CL_EXE,
+  CL_RUN,
 } CompilationLevel;
 
+typedef enum
+{
+  OL_O0,
+  OL_O1,
+  OL_O2,
+  OL_O3,
+  OL_Os,
+} OptLevel;
+
 typedef struct
 {
   std::vector<std::string> filenames;
+  std::vector<std::string> run_args;
   std::string output_name;
   std::string libs;
   bool nostdlib;
+  bool build_std;
+  bool build_io;
+  std::string std_dir;
+  std::string cache_dir;
+  bool cache_stats;
+  bool time_report;
+  bool time_report_json;
   CompilationLevel compilation_level;
+  OptLevel opt_level;
+  bool lto; // objects are bitcode, optimized together with the standard library when linked
+  bool profile_generate;
+  std::string profile_use; // .profdata merged from the runs of a --profile-generate build
+  bool instrument_contexts; // count calls and cycles of every context, reported when the program exits
 
   bool pic;
 } Settings;
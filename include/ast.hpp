@@ -0,0 +1,104 @@
+#if !defined(AST_H)
+#define AST_H
+
+#include <lexer.hpp>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Nodes keep the tokens they were parsed from, so the source buffer has to outlive the tree
+
+typedef enum
+{
+  EX_NUMBER,
+  EX_CHAR,
+  EX_STRING,
+  EX_VARIABLE,
+  EX_BINARY,
+  EX_COMPARE,
+} DCExprKind;
+
+typedef struct DCExpr
+{
+  DCExprKind kind;
+  Token token;       // the literal, the variable or the operator
+  int64_t value = 0; // EX_NUMBER, literals and the subexpressions folded into one
+  std::unique_ptr<DCExpr> lhs;
+  std::unique_ptr<DCExpr> rhs;
+} DCExpr;
+
+typedef enum
+{
+  ST_DECLARE,
+  ST_ASSIGN,
+  ST_ADDRESS,
+  ST_DEREF,
+  ST_RETURN,
+  ST_IF,
+  ST_ARRAY_LOAD,
+  ST_ARRAY_STORE,
+  ST_CALL,
+  ST_WHILE,
+} DCStmtKind;
+
+struct DCStmt;
+
+typedef struct
+{
+  std::unique_ptr<DCExpr> condition; // nullptr for else
+  std::vector<DCStmt> body;
+} DCIfArm;
+
+typedef struct DCStmt
+{
+  DCStmtKind kind;
+  int line = 0;
+  std::string_view type; // declared type or the explicit type of an assign
+  bool ptrAssign = false;
+  Token name;   // the variable, array or context the statement works on
+  Token target; // the variable after ->
+  std::unique_ptr<DCExpr> value;
+  std::unique_ptr<DCExpr> index;
+  std::vector<std::unique_ptr<DCExpr>> args;
+  std::vector<DCIfArm> arms;
+  std::unique_ptr<DCExpr> condition; // ST_WHILE, nullptr for a loop that only a return leaves
+  std::vector<DCStmt> body;          // ST_WHILE
+  int unroll = 0;                    // ST_WHILE, #unroll N
+  bool vectorize = false;            // ST_WHILE, #vectorize
+} DCStmt;
+
+typedef struct
+{
+  std::string_view type;
+  Token name;
+} DCParam;
+
+typedef struct
+{
+  Token name;
+  bool nomangle = false;
+  std::vector<DCParam> params;
+  std::string_view returnType = "void";
+  std::vector<DCStmt> body;
+  int line = 0;
+} DCContext;
+
+typedef struct
+{
+  Token name;
+  std::string_view returnType;
+  std::vector<std::string_view> params;
+  bool vararg = false;
+  int line = 0;
+} DCExtern;
+
+typedef struct
+{
+  std::vector<DCExtern> externs;
+  std::vector<DCContext> contexts;
+} DCFile;
+
+DCFile parseFile(Lexer &lexer);
+
+#endif // AST_H
@@ -0,0 +1,37 @@
+#if !defined(CACHE_H)
+#define CACHE_H
+
+#include <args.hpp>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Cache
+{
+public:
+  Cache(Settings &settings);
+
+  bool enabled;
+
+  std::string hash(const std::vector<std::string_view> &parts);
+
+  bool load(const std::string &key, const std::string &ext, std::string &contents);
+  void store(const std::string &key, const std::string &ext, const std::string &contents);
+
+  bool fetchFile(const std::string &key, const std::string &ext, const std::string &filename);
+  void storeFile(const std::string &key, const std::string &ext, const std::string &filename);
+
+  void report(bool print);
+
+private:
+  std::string dir;
+  std::string compilerId;
+  std::atomic<int> hits;
+  std::atomic<int> misses;
+
+  std::string path(const std::string &key, const std::string &ext);
+  std::string tempPath(const std::string &key, const std::string &ext);
+};
+
+#endif // CACHE_H
@@ -0,0 +1,28 @@
+#if !defined(CODEGEN_H)
+#define CODEGEN_H
+
+#include <args.hpp>
+#include <string>
+
+#include <llvm/IR/Module.h>
+#include <llvm/Support/CodeGen.h>
+#include <llvm/Target/TargetMachine.h>
+
+void initializeNativeTarget();
+
+llvm::TargetMachine *getTargetMachine(Settings &settings);
+
+// With -flto, objects and single-module bitcode only get the pre-link pipeline
+void optimizeModule(llvm::Module &module, Settings &settings);
+
+// The link-time pipeline, for the module -flto links every object and the standard library into
+void optimizeLinkedModule(llvm::Module &module, Settings &settings);
+
+void emitBitcode(llvm::Module &module, const std::string &filename);
+
+// Packs an object into a static archive, the linker only pulls it into programs that use one of its symbols
+void emitArchive(const std::string &object, const std::string &filename);
+
+void emitFile(llvm::Module &module, Settings &settings, const std::string &filename, llvm::CodeGenFileType type);
+
+#endif // CODEGEN_H
@@ -1,4 +1,59 @@
+#if !defined(COMPILER_H)
+#define COMPILER_H
+
 #include <args.hpp>
-#include <lexer.hpp>
+#include <ast.hpp>
+#include <error.hpp>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+
+typedef struct
+{
+  std::unique_ptr<llvm::LLVMContext> context;
+  std::unique_ptr<llvm::Module> module;
+} DCModule;
+
+[[noreturn]] void compilationError(const std::string &err, int line);
+
+// Whether programs can use the precompiled I/O library. With --nostdlib it is optional and only used when it was built
+bool linksIOLibrary(Settings &settings);
+
+// Symbols of the precompiled standard library, unless --nostdlib, and of the I/O library
+std::vector<std::string> loadStandardLibrary(Settings &settings);
+
+// Every function of the module other modules can link against, in the symbol table format
+std::vector<std::string> getModuleSymbols(llvm::Module &module);
+
+// What a context is looked up by, a link name or a name from the source. Mangled names keep neither digits nor underscores
+std::string getContextKey(std::string_view name);
+
+// Lowers the contexts [first, last) of the file, the other contexts are only declared
+DCModule compileModule(DCFile &file, Settings &settings, const std::vector<std::string> &symbols, size_t first, size_t last);
+
+// A single compilation of a program. Instances share no state, so any number of them can compile at once on different threads
+class CompilerInstance
+{
+public:
+  CompilerInstance(Settings settings);
+
+  // Returns the exit code, error() tells why a compilation failed
+  int compile();
+  const std::optional<DCError> &error() const;
+
+private:
+  Settings settings;
+  std::optional<DCError> lastError;
+
+  int compileProgram();
+};
+
+// Compiles like the dcc driver does, printing the error and the time report
+int compile(Settings &settings);
 
-void compile(Lexer &lexer, Settings &settings);
+#endif // COMPILER_H
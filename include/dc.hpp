@@ -0,0 +1,65 @@
+#if !defined(DC_H)
+#define DC_H
+
+#include <args.hpp>
+#include <error.hpp>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace llvm::orc
+{
+  class LLJIT;
+}
+
+/*
+  Embeds dc into a host program, sources are compiled in memory and run in the host process:
+
+  DCEngine engine;
+  engine.defineExtern("host_log", "void str", (void *)&hostLog);
+  if (!engine.load("context add i32 a i32 b -> i32; host_log(\"add\"); return a + b; context;"))
+  {
+    puts(engine.error()->what());
+  }
+  int (*add)(int, int) = engine.get<int(int, int)>("add");
+*/
+class DCEngine
+{
+public:
+  // Without a standard library directory only the host process and the registered externs can be called
+  DCEngine(OptLevel optLevel = OL_O0, const std::string &stdDir = "");
+  ~DCEngine();
+
+  // Makes a host function callable from every source loaded afterwards, the signature is written like an extern: "i32 str vararg"
+  void defineExtern(const std::string &name, const std::string &signature, void *address);
+
+  // Compiles the source and adds it to the engine, contexts of sources loaded before can be called. Every source needs its own
+  // name, one is made up when none is given
+  bool load(const std::string &source, const std::string &name = "");
+
+  // The address of a context by its name in the source, #nomangle or not, nullptr if there is none
+  void *lookup(const std::string &context);
+
+  template <typename Fn>
+  Fn *get(const std::string &context)
+  {
+    return reinterpret_cast<Fn *>(lookup(context));
+  }
+
+  // Why the last load or lookup failed
+  const std::optional<DCError> &error() const;
+
+private:
+  Settings settings;
+  std::unique_ptr<llvm::orc::LLJIT> jit;
+  std::vector<std::string> symbols;                           // what loaded sources can call, in the symbol table format
+  std::vector<std::pair<std::string, void *>> hostSymbols;   // defined in the JIT once it exists
+  std::vector<std::pair<std::string, std::string>> contexts; // lookup key -> link name of every loaded context
+  size_t unnamedLoads = 0;
+  std::optional<DCError> lastError;
+
+  void defineHostSymbol(const std::string &name, void *address);
+};
+
+#endif // DC_H
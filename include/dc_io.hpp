@@ -0,0 +1,8 @@
+#if !defined(DC_IO_H)
+#define DC_IO_H
+
+#define DC_IO_NAME "dcio"
+
+extern const char *dc_io_source;
+
+#endif // DC_IO_H
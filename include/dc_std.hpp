@@ -0,0 +1,8 @@
+#if !defined(DC_STD_H)
+#define DC_STD_H
+
+#define DC_STD_NAME "dcstd"
+
+extern const char *dc_std_source;
+
+#endif // DC_STD_H
@@ -0,0 +1,28 @@
+#if !defined(ERROR_H)
+#define ERROR_H
+
+#include <stdexcept>
+#include <string>
+
+typedef enum
+{
+  EK_COMPILATION, // an error in the compiled source, reported with its line
+  EK_FATAL,       // the compiler itself can not go on (missing files, failing linker, ...)
+} DCErrorKind;
+
+// Thrown wherever a compilation can not go on, CompilerInstance::compile catches it and hands it to the caller
+class DCError : public std::runtime_error
+{
+public:
+  DCError(DCErrorKind kind, const std::string &message, int line = 0);
+
+  DCErrorKind kind;
+  int line;
+
+  // The message the way dcc prints it
+  std::string format() const;
+};
+
+[[noreturn]] void fatalError(const std::string &message);
+
+#endif // ERROR_H
@@ -1,3 +1,9 @@
+#include <memory>
 #include <string>
 
-std::string readFile(const std::string &filename);
\ No newline at end of file
+#include <llvm/Support/MemoryBuffer.h>
+
+std::unique_ptr<llvm::MemoryBuffer> readFile(const std::string &filename);
+std::string getExecutablePath(const char *argv0);
+std::string getExecutableDir(const char *argv0);
+std::string getDefaultCacheDir();
\ No newline at end of file
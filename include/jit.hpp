@@ -0,0 +1,16 @@
+#if !defined(JIT_H)
+#define JIT_H
+
+#include <args.hpp>
+#include <memory>
+
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+
+// A JIT resolving externs from the running process, from the precompiled I/O library and, unless --nostdlib, from the standard library
+std::unique_ptr<llvm::orc::LLJIT> createJIT(Settings &settings);
+
+int runModule(std::unique_ptr<llvm::Module> module, std::unique_ptr<llvm::LLVMContext> context, Settings &settings);
+
+#endif // JIT_H
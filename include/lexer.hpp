@@ -2,10 +2,11 @@
 #define LEXER_H
 
 #include <string>
+#include <string_view>
 #include <cstdint>
 #include <vector>
 
-enum class TokenType
+enum class TokenType : uint8_t
 {
   KEYWORD,
   TYPE,
@@ -22,30 +23,62 @@ enum class TokenType
   END
 };
 
+// Tokens point into the source buffer, which has to outlive the lexer
 typedef struct Token
 {
   TokenType type;
-  std::string value;
-  int ptrCount;
+  uint16_t ptrCount;
+  uint32_t symbol; // interned id of keywords, types and identifiers, 0 for everything else
   int line;
+  std::string_view value;
 
-  Token(TokenType t, const std::string &v, int p = 0, int l = 0) : type(t), value(v), ptrCount(p), line(l) {}
+  Token() : type(TokenType::END), ptrCount(0), symbol(0), line(0), value("") {}
+  Token(TokenType t, std::string_view v, int p = 0, int l = 0, uint32_t s = 0) : type(t), ptrCount(p), symbol(s), line(l), value(v) {}
 } Token;
 
+// Open addressing over the symbol ids, interning a name that is already known does not allocate
+class Interner
+{
+public:
+  uint32_t intern(std::string_view name);
+  std::string_view name(uint32_t symbol);
+
+private:
+  std::vector<uint32_t> slots = std::vector<uint32_t>(256, 0); // symbol ids, 0 marks an empty slot
+  std::vector<std::string_view> names = {""};
+  std::vector<uint32_t> hashes = {0};
+
+  void grow();
+};
+
+// Tokens are lexed on demand, only the last WINDOW of them are kept around for rewinding
 class Lexer
 {
 public:
-  Lexer(const std::string &src, int startingLine = 0);
+  static const size_t WINDOW = 64;
+
+  Lexer(std::string_view src, int startingLine = 0);
+
+  // "avx2", "sse2" or "scalar", how this build scans runs of whitespace and identifier characters
+  static const char *scanner();
 
-  std::vector<Token> tokens;
-  void tokenize();
-  Token next();
-  int iterIndex;
+  Interner symbols;
+  const Token &next();
+  const Token &last();
+  bool rewind(size_t count = 1);
+  size_t count();
   int line;
 
 private:
-  std::string source;
+  std::string_view source;
   size_t current;
+  std::vector<Token> window;
+  size_t produced;
+  size_t position;
+  Token end;
+
+  Token scan();
+  Token symbol(TokenType type, size_t length);
 
   Token identifier();
 
@@ -54,9 +87,6 @@ private:
   Token character();
 
   Token stringLiteral();
-
-  bool isKeyword(const std::string &value);
-  bool isType(std::string &value);
 };
 
 #endif // LEXER_H
@@ -0,0 +1,12 @@
+#if !defined(PARALLEL_H)
+#define PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+unsigned getWorkerCount(size_t jobs);
+
+// The first exception thrown by a job is rethrown on the calling thread once every worker stopped
+void parallelFor(size_t jobs, const std::function<void(size_t)> &fn);
+
+#endif // PARALLEL_H
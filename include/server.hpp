@@ -0,0 +1,17 @@
+#if !defined(SERVER_H)
+#define SERVER_H
+
+#include <functional>
+#include <string>
+
+// Runs one dcc command line and returns its exit code
+typedef std::function<int(int argc, char **argv)> DCDriver;
+
+// Serves requests on a Unix socket until killed. Every request runs the driver in a process forked from the
+// warm server, in the working directory and with the standard streams of the client
+int runServer(const std::string &socketPath, const DCDriver &driver);
+
+// Sends the command line to the server, returns the exit code of the request or -1 when no server listens
+int runClient(const std::string &socketPath, int argc, char **argv);
+
+#endif // SERVER_H
@@ -0,0 +1,33 @@
+#if !defined(TIMING_H)
+#define TIMING_H
+
+#include <args.hpp>
+#include <chrono>
+#include <cstdint>
+
+// Accumulates wall and CPU time of a compiler phase for --time-report while it is in scope
+class TimeRegion
+{
+public:
+  TimeRegion(const char *phase);
+  ~TimeRegion();
+
+private:
+  const char *phase;
+  std::chrono::steady_clock::time_point wallStart;
+  double cpuStart;
+};
+
+typedef enum
+{
+  TC_TOKENS,
+  TC_IR_INSTRUCTIONS,
+  TC_EMITTED_BYTES,
+  TC_COUNT,
+} TimeCounter;
+
+void startTimeReport(Settings &settings);
+void addTimeCounter(TimeCounter counter, uint64_t value);
+void printTimeReport(Settings &settings);
+
+#endif // TIMING_H
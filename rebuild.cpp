@@ -6,10 +6,20 @@ std::string iflags = "-Iinclude";
 int main(int argc, char **argv) {
   system("mkdir -p build");
   rebuild_targets.push_back(
-      Target::create("build/dcc",
-                     {"build/args.o", "build/dcc.o", "build/fs.o",
-                      "build/lexer.o", "build/compiler.o"},
-                     "g++ -o #OUT #DEPENDS -lLLVM-19"));
+      Target::create("build/libdc.a",
+                     {"build/args.o", "build/error.o", "build/fs.o",
+                      "build/lexer.o", "build/parser.o", "build/compiler.o", "build/codegen.o", "build/jit.o", "build/engine.o",
+                      "build/dc_std.o", "build/dc_io.o", "build/parallel.o",
+                      "build/cache.o", "build/server.o", "build/timing.o"},
+                     "ar rcs #OUT #DEPENDS"));
+  rebuild_targets.push_back(
+      Target::create("build/dcc", {"build/dcc.o", "build/libdc.a"},
+                     "g++ -o #OUT #DEPENDS -lLLVM-19 -lpthread"));
+
+  rebuild_targets.push_back(
+      Target::create("build/dcc-client",
+                     {"build/dcc_client.o", "build/server.o", "build/error.o"},
+                     "g++ -o #OUT #DEPENDS"));
 
   rebuild_targets.push_back(CTarget::create(
       "build/args.o", {"src/args.cpp"}, "g++ -o #OUT #DEPENDS " + cflags,
@@ -17,14 +27,54 @@ int main(int argc, char **argv) {
   rebuild_targets.push_back(CTarget::create(
       "build/dcc.o", {"src/dcc.cpp"}, "g++ -o #OUT #DEPENDS " + cflags,
       REBUILD_STANDARD_CXX_COMPILER, iflags));
+  rebuild_targets.push_back(CTarget::create(
+      "build/error.o", {"src/error.cpp"}, "g++ -o #OUT #DEPENDS " + cflags,
+      REBUILD_STANDARD_CXX_COMPILER, iflags));
+  rebuild_targets.push_back(CTarget::create(
+      "build/dcc_client.o", {"src/dcc_client.cpp"},
+      "g++ -o #OUT #DEPENDS " + cflags, REBUILD_STANDARD_CXX_COMPILER, iflags));
   rebuild_targets.push_back(CTarget::create(
       "build/fs.o", {"src/fs.cpp"}, "g++ -o #OUT #DEPENDS " + cflags,
       REBUILD_STANDARD_CXX_COMPILER, iflags));
   rebuild_targets.push_back(CTarget::create(
       "build/lexer.o", {"src/lexer.cpp"}, "g++ -o #OUT #DEPENDS " + cflags,
       REBUILD_STANDARD_CXX_COMPILER, iflags));
+  rebuild_targets.push_back(CTarget::create(
+      "build/parser.o", {"src/parser.cpp"}, "g++ -o #OUT #DEPENDS " + cflags,
+      REBUILD_STANDARD_CXX_COMPILER, iflags));
   rebuild_targets.push_back(CTarget::create(
       "build/compiler.o", {"src/compiler.cpp"},
       "g++ -o #OUT #DEPENDS " + cflags, REBUILD_STANDARD_CXX_COMPILER, iflags));
+  rebuild_targets.push_back(CTarget::create(
+      "build/codegen.o", {"src/codegen.cpp"},
+      "g++ -o #OUT #DEPENDS " + cflags, REBUILD_STANDARD_CXX_COMPILER, iflags));
+  rebuild_targets.push_back(CTarget::create(
+      "build/jit.o", {"src/jit.cpp"}, "g++ -o #OUT #DEPENDS " + cflags,
+      REBUILD_STANDARD_CXX_COMPILER, iflags));
+  rebuild_targets.push_back(CTarget::create(
+      "build/engine.o", {"src/engine.cpp"}, "g++ -o #OUT #DEPENDS " + cflags,
+      REBUILD_STANDARD_CXX_COMPILER, iflags));
+  rebuild_targets.push_back(CTarget::create(
+      "build/dc_std.o", {"src/dc_std.cpp"}, "g++ -o #OUT #DEPENDS " + cflags,
+      REBUILD_STANDARD_CXX_COMPILER, iflags));
+  rebuild_targets.push_back(CTarget::create(
+      "build/dc_io.o", {"src/dc_io.cpp"}, "g++ -o #OUT #DEPENDS " + cflags,
+      REBUILD_STANDARD_CXX_COMPILER, iflags));
+  rebuild_targets.push_back(CTarget::create(
+      "build/parallel.o", {"src/parallel.cpp"},
+      "g++ -o #OUT #DEPENDS " + cflags, REBUILD_STANDARD_CXX_COMPILER, iflags));
+  rebuild_targets.push_back(CTarget::create(
+      "build/cache.o", {"src/cache.cpp"}, "g++ -o #OUT #DEPENDS " + cflags,
+      REBUILD_STANDARD_CXX_COMPILER, iflags));
+  rebuild_targets.push_back(CTarget::create(
+      "build/server.o", {"src/server.cpp"}, "g++ -o #OUT #DEPENDS " + cflags,
+      REBUILD_STANDARD_CXX_COMPILER, iflags));
+  rebuild_targets.push_back(CTarget::create(
+      "build/timing.o", {"src/timing.cpp"}, "g++ -o #OUT #DEPENDS " + cflags,
+      REBUILD_STANDARD_CXX_COMPILER, iflags));
+  rebuild_targets.push_back(Target::create(
+      "build/dcstd.o", {"build/dcc"}, "cd build && ./dcc --build-std -O2 -o dcstd"));
+  rebuild_targets.push_back(Target::create(
+      "build/dcio.a", {"build/dcc"}, "cd build && ./dcc --build-io -O2 -o dcio"));
   return 0;
 }
@@ -0,0 +1,141 @@
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/BLAKE3.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+
+#include <cache.hpp>
+#include <fs.hpp>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+using namespace llvm;
+
+Cache::Cache(Settings &settings) : enabled(!settings.cache_dir.empty()), dir(settings.cache_dir), hits(0), misses(0)
+{
+  if (!enabled)
+  {
+    return;
+  }
+
+  if (sys::fs::create_directories(dir))
+  {
+    printf("\x1b[1mdcc:\x1b[0m \x1b[1;35mwarning:\x1b[0m failed to create cache directory %s, caching disabled\n", dir.c_str());
+    enabled = false;
+    return;
+  }
+
+  // A rebuilt dcc must not reuse objects of an older one, so the executable itself is part of every key
+  sys::fs::file_status status;
+  std::string executable = getExecutablePath(nullptr);
+  compilerId = DCC_VER " " + executable;
+  if (!sys::fs::status(executable, status))
+  {
+    compilerId += " " + std::to_string(status.getSize()) + " " + std::to_string(status.getLastModificationTime().time_since_epoch().count());
+  }
+}
+
+std::string Cache::hash(const std::vector<std::string_view> &parts)
+{
+  BLAKE3 hasher;
+  hasher.update(compilerId);
+  for (std::string_view part : parts)
+  {
+    // Length prefixes keep ("ab", "c") and ("a", "bc") apart
+    hasher.update(std::to_string(part.size()) + ":");
+    hasher.update(StringRef(part.data(), part.size()));
+  }
+  return toHex(hasher.final<16>(), true);
+}
+
+std::string Cache::path(const std::string &key, const std::string &ext)
+{
+  return dir + "/" + key + "." + ext;
+}
+
+std::string Cache::tempPath(const std::string &key, const std::string &ext)
+{
+  std::stringstream id;
+  id << getpid() << "-" << std::this_thread::get_id();
+  return dir + "/" + key + "." + ext + ".tmp" + id.str();
+}
+
+bool Cache::load(const std::string &key, const std::string &ext, std::string &contents)
+{
+  std::ifstream file(path(key, ext), std::ios::binary);
+  if (!file)
+  {
+    return false;
+  }
+
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  contents = buffer.str();
+  return true;
+}
+
+void Cache::store(const std::string &key, const std::string &ext, const std::string &contents)
+{
+  // Entries are written under a temporary name and renamed, concurrent dcc processes never see half a file
+  std::string temp = tempPath(key, ext);
+  {
+    std::ofstream file(temp, std::ios::binary);
+    if (!file)
+    {
+      return;
+    }
+    file << contents;
+  }
+  if (sys::fs::rename(temp, path(key, ext)))
+  {
+    sys::fs::remove(temp);
+  }
+}
+
+bool Cache::fetchFile(const std::string &key, const std::string &ext, const std::string &filename)
+{
+  if (sys::fs::exists(path(key, ext)) && !sys::fs::copy_file(path(key, ext), filename))
+  {
+    hits++;
+    return true;
+  }
+
+  misses++;
+  return false;
+}
+
+void Cache::storeFile(const std::string &key, const std::string &ext, const std::string &filename)
+{
+  std::string temp = tempPath(key, ext);
+  if (sys::fs::copy_file(filename, temp) || sys::fs::rename(temp, path(key, ext)))
+  {
+    sys::fs::remove(temp);
+  }
+}
+
+void Cache::report(bool print)
+{
+  if (!enabled || hits + misses == 0)
+  {
+    return;
+  }
+
+  // Totals across every invocation using this cache directory are kept next to the entries
+  long totalHits = 0;
+  long totalMisses = 0;
+  std::string stats;
+  if (load("stats", "txt", stats))
+  {
+    std::stringstream(stats) >> totalHits >> totalMisses;
+  }
+  totalHits += hits;
+  totalMisses += misses;
+  store("stats", "txt", std::to_string(totalHits) + " " + std::to_string(totalMisses) + "\n");
+
+  if (print)
+  {
+    printf("\x1b[1mdcc:\x1b[0m cache: %d hits, %d misses this run, %ld hits, %ld misses in total (%s)\n",
+           hits.load(), misses.load(), totalHits, totalMisses, dir.c_str());
+  }
+}
@@ -0,0 +1,237 @@
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Object/ArchiveWriter.h>
+#include <llvm/Passes/OptimizationLevel.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/PGOOptions.h>
+#include <llvm/Support/VirtualFileSystem.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetOptions.h>
+#include <llvm/TargetParser/Host.h>
+
+#include <codegen.hpp>
+#include <error.hpp>
+#include <timing.hpp>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+using namespace llvm;
+
+static CodeGenOptLevel getCodeGenOptLevel(OptLevel level)
+{
+  switch (level)
+  {
+  case OL_O0:
+    return CodeGenOptLevel::None;
+  case OL_O1:
+    return CodeGenOptLevel::Less;
+  case OL_O3:
+    return CodeGenOptLevel::Aggressive;
+  default:
+    return CodeGenOptLevel::Default;
+  }
+}
+
+static OptimizationLevel getOptimizationLevel(OptLevel level)
+{
+  switch (level)
+  {
+  case OL_O1:
+    return OptimizationLevel::O1;
+  case OL_O2:
+    return OptimizationLevel::O2;
+  case OL_O3:
+    return OptimizationLevel::O3;
+  case OL_Os:
+    return OptimizationLevel::Os;
+  default:
+    return OptimizationLevel::O0;
+  }
+}
+
+void initializeNativeTarget()
+{
+  static std::once_flag initialized;
+  std::call_once(initialized, []()
+                 {
+                   InitializeNativeTarget();
+                   InitializeNativeTargetAsmPrinter(); });
+}
+
+TargetMachine *getTargetMachine(Settings &settings)
+{
+  // Target machines are not thread safe, every worker thread creates its own for every configuration it compiles with
+  static thread_local std::map<std::pair<OptLevel, bool>, std::unique_ptr<TargetMachine>> targetMachines;
+  std::unique_ptr<TargetMachine> &targetMachine = targetMachines[{settings.opt_level, settings.pic}];
+  if (targetMachine != nullptr)
+  {
+    return targetMachine.get();
+  }
+
+  initializeNativeTarget();
+  std::string triple = sys::getDefaultTargetTriple();
+  std::string error;
+  const Target *target = TargetRegistry::lookupTarget(triple, error);
+  if (target == nullptr)
+  {
+    fatalError(error);
+  }
+
+  TargetOptions options;
+  std::optional<Reloc::Model> relocModel = settings.pic ? Reloc::PIC_ : Reloc::Static;
+  targetMachine.reset(target->createTargetMachine(triple, "generic", "", options, relocModel, std::nullopt, getCodeGenOptLevel(settings.opt_level)));
+  return targetMachine.get();
+}
+
+typedef enum
+{
+  PP_DEFAULT,
+  PP_PRELINK, // bitcode objects of -flto, optimized again once linked
+  PP_LTO,     // the whole program at link time
+} PipelinePhase;
+
+static std::optional<PGOOptions> getPGOOptions(Settings &settings)
+{
+  if (settings.profile_generate)
+  {
+    // The runtime writes default.profraw, or whatever LLVM_PROFILE_FILE names
+    return PGOOptions("", "", "", "", vfs::getRealFileSystem(), PGOOptions::IRInstr);
+  }
+
+  if (!settings.profile_use.empty())
+  {
+    if (!sys::fs::exists(settings.profile_use))
+    {
+      fatalError("failed to open " + settings.profile_use);
+    }
+    return PGOOptions(settings.profile_use, "", "", "", vfs::getRealFileSystem(), PGOOptions::IRUse);
+  }
+  return std::nullopt;
+}
+
+static void runPipeline(Module &module, Settings &settings, PipelinePhase phase)
+{
+  TimeRegion optimizeTime(phase == PP_LTO ? "optimize linked" : "optimize");
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+
+  PipelineTuningOptions tuning;
+  tuning.LoopVectorization = settings.opt_level != OL_O1;
+  tuning.SLPVectorization = settings.opt_level != OL_O1;
+
+  PassBuilder passBuilder(getTargetMachine(settings), tuning, getPGOOptions(settings));
+  passBuilder.registerModuleAnalyses(MAM);
+  passBuilder.registerCGSCCAnalyses(CGAM);
+  passBuilder.registerFunctionAnalyses(FAM);
+  passBuilder.registerLoopAnalyses(LAM);
+  passBuilder.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  OptimizationLevel level = getOptimizationLevel(settings.opt_level);
+  ModulePassManager MPM;
+  if (level == OptimizationLevel::O0)
+  {
+    // Only reached to instrument or annotate with a profile
+    MPM = passBuilder.buildO0DefaultPipeline(level);
+    MPM.run(module, MAM);
+    return;
+  }
+
+  switch (phase)
+  {
+  case PP_PRELINK:
+    MPM = passBuilder.buildLTOPreLinkDefaultPipeline(level);
+    break;
+  case PP_LTO:
+    MPM = passBuilder.buildLTODefaultPipeline(level, nullptr);
+    break;
+  default:
+    MPM = passBuilder.buildPerModuleDefaultPipeline(level);
+    break;
+  }
+  MPM.run(module, MAM);
+}
+
+void optimizeModule(Module &module, Settings &settings)
+{
+  if (settings.opt_level == OL_O0 && !settings.profile_generate && settings.profile_use.empty())
+  {
+    return;
+  }
+
+  // Bitcode objects are only simplified, inlining and code generation decisions wait for the whole program
+  bool bitcode = settings.lto && (settings.compilation_level == CL_OBJ || settings.compilation_level == CL_EXE);
+  runPipeline(module, settings, bitcode ? PP_PRELINK : PP_DEFAULT);
+}
+
+void optimizeLinkedModule(Module &module, Settings &settings)
+{
+  if (settings.opt_level == OL_O0)
+  {
+    return;
+  }
+  runPipeline(module, settings, PP_LTO);
+}
+
+void emitBitcode(Module &module, const std::string &filename)
+{
+  TimeRegion emitTime("emit");
+  std::error_code EC;
+  raw_fd_ostream dest(filename, EC, sys::fs::OF_None);
+  if (EC)
+  {
+    fatalError("failed to open " + filename + ": " + EC.message());
+  }
+
+  WriteBitcodeToFile(module, dest);
+  dest.flush();
+  addTimeCounter(TC_EMITTED_BYTES, dest.tell());
+}
+
+void emitArchive(const std::string &object, const std::string &filename)
+{
+  TimeRegion emitTime("emit");
+  Expected<NewArchiveMember> member = NewArchiveMember::getFile(object, true);
+  if (!member)
+  {
+    fatalError(object + ": " + toString(member.takeError()));
+  }
+
+  std::vector<NewArchiveMember> members;
+  members.push_back(std::move(*member));
+  if (Error err = writeArchive(filename, members, SymtabWritingMode::NormalSymtab, object::Archive::K_GNU, true, false))
+  {
+    fatalError("failed to write " + filename + ": " + toString(std::move(err)));
+  }
+}
+
+void emitFile(Module &module, Settings &settings, const std::string &filename, CodeGenFileType type)
+{
+  TargetMachine *targetMachine = getTargetMachine(settings);
+  TimeRegion emitTime("emit");
+
+  std::error_code EC;
+  raw_fd_ostream dest(filename, EC, type == CodeGenFileType::AssemblyFile ? sys::fs::OF_Text : sys::fs::OF_None);
+  if (EC)
+  {
+    fatalError("failed to open " + filename + ": " + EC.message());
+  }
+
+  legacy::PassManager pass;
+  if (targetMachine->addPassesToEmitFile(pass, dest, nullptr, type))
+  {
+    fatalError("target can't emit a file of this type");
+  }
+
+  pass.run(module);
+  dest.flush();
+  addTimeCounter(TC_EMITTED_BYTES, dest.tell());
+}
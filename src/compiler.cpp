@@ -5,18 +5,35 @@
 #include <llvm/IR/Verifier.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include <ast.hpp>
 #include <lexer.hpp>
-#include <stack>
 #include <args.hpp>
-#include <iostream>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Transforms/IPO/Internalize.h>
+#include <llvm/Transforms/Utils/ModuleUtils.h>
+
+#include <cache.hpp>
+#include <codegen.hpp>
+#include <compiler.hpp>
+#include <dc_io.hpp>
+#include <dc_std.hpp>
+#include <error.hpp>
+#include <fs.hpp>
+#include <jit.hpp>
+#include <parallel.hpp>
+#include <timing.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
 
 using namespace llvm;
 
-LLVMContext context;
-IRBuilder<> builder(context);
-Module fmodule("dc", context);
-Lexer *g_lexer;
-
 #pragma region collapseThis
 
 typedef struct
@@ -24,34 +41,86 @@ typedef struct
   Type *llvmType;
   std::string hardcodedName;
   Value *llvmVar;
+  Type *elementType; // what array indexes step over
 } DCVariable;
 
-typedef struct
-{
-  BasicBlock *trueBlock;
-  BasicBlock *falseBlock;
-  BasicBlock *mergeBlock;
-  bool elif;
-} DCIfStatement;
-
 typedef struct
 {
   FunctionType *fnType;
   Function *fn;
-  BasicBlock *fnBlock;
-  std::vector<DCVariable> variables;
-  std::vector<DCIfStatement> ifstatements;
+  std::unordered_map<uint32_t, DCVariable> variables; // keyed by the interned name
+  bool frameEscapes;                                  // a local has its address taken, calls can't reuse the frame
+  Value *profileSlot = nullptr;                       // --instrument-contexts, {calls, cycles} of this context
+  Value *profileStart = nullptr;                      // cycle counter on entry
 } DCFunction;
 
-std::vector<DCFunction> functions;
-std::vector<DCFunction> all_functions;
+// Contexts of a file are only split into chunks lowered in parallel when every chunk gets at least this many
+static const size_t CHUNK_CONTEXTS = 64;
 
-Value *parseExpr(Type *preferred_type = nullptr, bool rewind = false, std::string stopExprValue = "");
-
-llvm::Value *castValue(llvm::Value *value, llvm::Type *targetType)
+// Lowers files into one module, every chunk of every compilation gets its own instance and nothing is shared between them
+class ModuleCompiler
+{
+public:
+  ModuleCompiler(Settings &settings);
+
+  std::vector<std::string> collectSymbols(DCFile &file);
+  DCModule compile(DCFile &file, const std::vector<std::string> &symbols, size_t first, size_t last);
+
+private:
+  std::unique_ptr<LLVMContext> context;
+  std::unique_ptr<IRBuilder<>> builder;
+  std::unique_ptr<Module> fmodule;
+  int errorLine = 0;
+
+  // Every context the module can call, keyed by its demangled name
+  std::unordered_map<std::string, Function *> contextIndex;
+
+  // --instrument-contexts, every context lowered into the module gets a slot in the module's profile tables
+  bool instrument = false;
+  bool threadLocalTables = true;
+  GlobalVariable *profileTable = nullptr; // the table of the running thread
+  Function *profileGetTable = nullptr;
+  std::vector<std::string> profileNames;
+
+  void compilationError(const std::string &err);
+
+  Value *castValue(Value *value, Type *targetType);
+  std::string mangleCtxName(Type *returnType, std::vector<Type *> fnArgs, std::string name);
+  void indexContext(Function *fn);
+  Function *getContext(std::string_view raw);
+  Type *getTypeFromStr(std::string_view str);
+  Type *getElementTypeFromStr(std::string_view str);
+  DCVariable *getVarFromFunction(DCFunction &fn, const Token &name);
+  void declareSymbol(const std::string &symbol);
+
+  Value *convertValue(Value *value, Type *type);
+  Value *lowerExpr(DCFunction &fn, const DCExpr &expr, Type *type);
+  Value *lowerCondition(DCFunction &fn, const DCExpr &expr);
+  bool isTerminated();
+  void lowerBlock(DCFunction &fn, const std::vector<DCStmt> &body);
+  void lowerIf(DCFunction &fn, const DCStmt &stmt);
+  MDNode *getLoopMetadata(const DCStmt &stmt);
+  void lowerWhile(DCFunction &fn, const DCStmt &stmt);
+  bool isTailCall(DCFunction &fn, const DCStmt &call, const DCStmt &ret);
+  bool lowerBuiltin(DCFunction &fn, const DCStmt &stmt);
+  void lowerCall(DCFunction &fn, const DCStmt &stmt, bool tail);
+  void lowerStatement(DCFunction &fn, const DCStmt &stmt, bool tail);
+  void lowerContext(const DCContext &ctx, Function *ctxFn);
+
+  StructType *getProfileSlotType();
+  void profileEntry(DCFunction &fn);
+  void profileExit(DCFunction &fn);
+  void emitProfileRuntime();
+
+  FunctionType *getContextType(const DCContext &ctx);
+  std::string getContextName(const DCContext &ctx, FunctionType *ctxType);
+  FunctionType *getExternType(const DCExtern &ext);
+};
+
+Value *ModuleCompiler::castValue(Value *value, Type *targetType)
 {
   // Get the current context
-  llvm::LLVMContext &context = builder.getContext();
+  llvm::LLVMContext &context = builder->getContext();
 
   // Check if the value is already of the target type
   if (value->getType() == targetType)
@@ -65,7 +134,7 @@ llvm::Value *castValue(llvm::Value *value, llvm::Type *targetType)
     if (targetType->isIntegerTy())
     {
       // Pointer to Integer cast
-      return builder.CreatePtrToInt(value, targetType, "ptr_to_int");
+      return builder->CreatePtrToInt(value, targetType, "ptr_to_int");
     }
   }
   else if (llvm::PointerType *targetPtrType = llvm::dyn_cast<llvm::PointerType>(targetType))
@@ -73,7 +142,7 @@ llvm::Value *castValue(llvm::Value *value, llvm::Type *targetType)
     if (value->getType()->isIntegerTy())
     {
       // Integer to Pointer cast
-      return builder.CreateIntToPtr(value, targetPtrType, "int_to_ptr");
+      return builder->CreateIntToPtr(value, targetPtrType, "int_to_ptr");
     }
   }
 
@@ -81,22 +150,22 @@ llvm::Value *castValue(llvm::Value *value, llvm::Type *targetType)
   if (value->getType()->isIntegerTy() && targetType->isIntegerTy())
   {
     // Integer to Integer cast
-    return builder.CreateIntCast(value, targetType, true, "int_cast");
+    return builder->CreateIntCast(value, targetType, true, "int_cast");
   }
   else if (value->getType()->isFloatingPointTy() && targetType->isFloatingPointTy())
   {
     // Float to Float cast
-    return builder.CreateFPCast(value, targetType, "fp_cast");
+    return builder->CreateFPCast(value, targetType, "fp_cast");
   }
   else if (value->getType()->isIntegerTy() && targetType->isFloatingPointTy())
   {
     // Integer to Float cast
-    return builder.CreateSIToFP(value, targetType, "int_to_fp");
+    return builder->CreateSIToFP(value, targetType, "int_to_fp");
   }
   else if (value->getType()->isFloatingPointTy() && targetType->isIntegerTy())
   {
     // Float to Integer cast
-    return builder.CreateFPToSI(value, targetType, "fp_to_int");
+    return builder->CreateFPToSI(value, targetType, "fp_to_int");
   }
   else if (value->getType()->isIntegerTy() && targetType->isIntegerTy())
   {
@@ -109,12 +178,12 @@ llvm::Value *castValue(llvm::Value *value, llvm::Type *targetType)
       if (sourceType->getBitWidth() > targetIntType->getBitWidth())
       {
         // Source type has more bits than target type, perform truncation
-        return builder.CreateTrunc(value, targetType, "trunc");
+        return builder->CreateTrunc(value, targetType, "trunc");
       }
       else if (sourceType->getBitWidth() < targetIntType->getBitWidth())
       {
         // Source type has fewer bits than target type, perform extension
-        return builder.CreateZExt(value, targetType, "zext"); // Use CreateSExt for signed extension
+        return builder->CreateZExt(value, targetType, "zext"); // Use CreateSExt for signed extension
       }
     }
   }
@@ -189,13 +258,13 @@ std::string getTypeName(llvm::Type *type)
   return rso.str();
 }
 
-std::string mangleCtxName(Type *returnType, std::vector<Type *> fnArgs, std::string name)
+std::string ModuleCompiler::mangleCtxName(Type *returnType, std::vector<Type *> fnArgs, std::string name)
 {
   if (name == "main")
     return "main";
-  std::string moduleId = deleteDigits(replaceAll(fmodule.getModuleIdentifier(), "_", ""));
+  std::string moduleId = deleteDigits(replaceAll(fmodule->getModuleIdentifier(), "_", ""));
   std::string fnName = deleteDigits(replaceAll(name, "_", ""));
-  // std::string res = "_Z" + std::to_string(fnArgs.size()) + "_" + replaceAll(fmodule.getModuleIdentifier(), "_", "");
+  // std::string res = "_Z" + std::to_string(fnArgs.size()) + "_" + replaceAll(fmodule->getModuleIdentifier(), "_", "");
   std::string res = "_Z" + std::to_string(fnName.length()) + fnName + std::to_string(moduleId.length()) + moduleId + "_";
   res += getTypeName(returnType);
   res += "_";
@@ -246,65 +315,63 @@ std::string demangleCtxName(std::string mangled)
   return fnNameDemangled;
 }
 
-void compilationError(std::string err)
+void compilationError(const std::string &err, int line)
 {
-  printf(std::string("\x1b[1mdcc:\x1b[0m \x1b[1;31mcompilation error:\n ~" + std::to_string(g_lexer->tokens[g_lexer->iterIndex].line) + " | \x1b[0m %s\n").c_str(), err.c_str());
-  exit(1);
+  throw DCError(EK_COMPILATION, err, line);
 }
 
-std::string getMangledName(std::string raw)
+void ModuleCompiler::compilationError(const std::string &err)
 {
-  if (raw == "main")
-    return "main";
-  for (DCFunction &fn : all_functions)
+  ::compilationError(err, errorLine);
+}
+
+void ModuleCompiler::indexContext(Function *fn)
+{
+  // The first context of a name wins, like the declaration order did before
+  contextIndex.try_emplace(demangleCtxName(fn->getName().str()), fn);
+}
+
+Function *ModuleCompiler::getContext(std::string_view raw)
+{
+  if (raw != "main")
   {
-    std::string fnName = fn.fn->getName().str();
-    std::string current = demangleCtxName(fnName);
-    if (current == deleteDigits(replaceAll(raw, "_", "")))
+    auto it = contextIndex.find(getContextKey(raw));
+    if (it != contextIndex.end())
     {
-      return fnName;
+      return it->second;
     }
   }
-  return raw;
+  return fmodule->getFunction(raw);
 }
 
-Type *getTypeFromStr(std::string str)
+Type *ModuleCompiler::getTypeFromStr(std::string_view str)
 {
-  std::string v = str;
-
-  try
-  {
-    v.erase(std::remove(v.begin(), v.end(), '*'), v.end());
-  }
-  catch (std::length_error &e)
-  {
-    // do nothing
-  }
+  std::string_view v = str.substr(0, str.find('*'));
 
   Type *res = nullptr;
   if (v == "i64")
   {
-    res = builder.getInt64Ty();
+    res = builder->getInt64Ty();
   }
   else if (v == "i32")
   {
-    res = builder.getInt32Ty();
+    res = builder->getInt32Ty();
   }
   else if (v == "i8")
   {
-    res = builder.getInt8Ty();
+    res = builder->getInt8Ty();
   }
   else if (v == "ptr")
   {
-    res = builder.getPtrTy();
+    res = builder->getPtrTy();
   }
   else if (v == "void")
   {
-    res = builder.getVoidTy();
+    res = builder->getVoidTy();
   }
   else if (v == "str")
   {
-    res = builder.getInt8Ty()->getPointerTo();
+    res = builder->getInt8Ty()->getPointerTo();
   }
 
   int ptrCount = std::count(str.begin(), str.end(), '*');
@@ -319,30 +386,30 @@ Type *getTypeFromStr(std::string str)
 
   if (res == nullptr)
   {
-    compilationError("Unknown type: " + v);
+    compilationError("Unknown type: " + std::string(str));
   }
   return res;
 }
 
-void catchAndExit(Token &token)
+// Indexing a T* steps over T, str and ptr are indexed byte by byte
+Type *ModuleCompiler::getElementTypeFromStr(std::string_view str)
 {
-  if (token.type == TokenType::END)
+  if (!str.empty() && str.back() == '*')
   {
-    compilationError("unexcepted EOF");
+    return getTypeFromStr(str.substr(0, str.size() - 1));
   }
+  return builder->getInt8Ty();
 }
 
-DCVariable *getVarFromFunction(DCFunction &fn, std::string name)
+DCVariable *ModuleCompiler::getVarFromFunction(DCFunction &fn, const Token &name)
 {
-  for (DCVariable &var : fn.variables)
+  auto it = fn.variables.find(name.symbol);
+  if (name.symbol == 0 || it == fn.variables.end())
   {
-    if (var.llvmVar->getName() == name || var.hardcodedName == name)
-    {
-      return &var;
-    }
+    compilationError("Unknown variable: " + std::string(name.value));
+    return nullptr;
   }
-  compilationError("Unknown variable: " + name);
-  return nullptr;
+  return &it->second;
 }
 
 std::string parseEscapeSequences(const std::string &input)
@@ -385,825 +452,1121 @@ std::string parseEscapeSequences(const std::string &input)
   return output;
 }
 
-void emitStandardLibrary()
+// Every symbol is "<link name> <return type> <argument types...> [vararg]", the same format dcstd.sym is stored in
+void ModuleCompiler::declareSymbol(const std::string &symbol)
+{
+  std::vector<std::string> fields = split(symbol, " ");
+  if (fields.size() < 2)
+  {
+    return;
+  }
+
+  std::vector<Type *> argTypes;
+  bool vararg = false;
+  for (int i = 2; i < fields.size(); i++)
+  {
+    if (fields.at(i) == "vararg")
+    {
+      vararg = true;
+    }
+    else
+    {
+      argTypes.push_back(getTypeFromStr(fields.at(i)));
+    }
+  }
+
+  FunctionType *fnType = FunctionType::get(getTypeFromStr(fields.at(1)), argTypes, vararg);
+  Function *fn = cast<Function>(fmodule->getOrInsertFunction(fields.at(0), fnType).getCallee());
+  if (fields.at(0).starts_with("_Z"))
+  {
+    indexContext(fn);
+  }
+}
+
+bool linksIOLibrary(Settings &settings)
 {
-  return;
+  if (settings.build_std || settings.build_io || settings.std_dir.empty())
+  {
+    return false;
+  }
+  return !settings.nostdlib || sys::fs::exists(settings.std_dir + "/" DC_IO_NAME ".sym");
 }
 
-Value *perform_LLVM_operation(Value *operand1, Value *operand2, char op)
+static std::vector<std::string> readSymbolTable(const std::string &symbolTable, const std::string &hint)
 {
-  switch (op)
+  // The table is read once per process and kept while the file is unchanged, a compile server reuses it for every request
+  static std::mutex loadedMutex;
+  static std::unordered_map<std::string, std::pair<sys::TimePoint<>, std::vector<std::string>>> loaded;
+  sys::fs::file_status status;
+  bool exists = !sys::fs::status(symbolTable, status);
+  std::lock_guard<std::mutex> lock(loadedMutex);
+  auto it = loaded.find(symbolTable);
+  if (exists && it != loaded.end() && it->second.first == status.getLastModificationTime())
   {
-  case '+':
-    return builder.CreateAdd(operand1, operand2);
-    break;
-  case '-':
-    return builder.CreateSub(operand1, operand2);
-    break;
-  case '*':
-    return builder.CreateMul(operand1, operand2);
-    break;
-  case '/':
-    return builder.CreateSDiv(operand1, operand2);
-    break;
+    return it->second.second;
   }
-  return nullptr;
+
+  std::ifstream file(symbolTable);
+  if (!file)
+  {
+    fatalError("failed to open " + symbolTable + hint);
+  }
+
+  std::vector<std::string> symbols;
+  std::string line;
+  while (std::getline(file, line))
+  {
+    symbols.push_back(line);
+  }
+  loaded[symbolTable] = {status.getLastModificationTime(), symbols};
+  return symbols;
 }
 
-Value *evaluate_expression(std::vector<Token> expr, Type *preferred_type)
+std::vector<std::string> loadStandardLibrary(Settings &settings)
 {
-  std::stack<Value *> values;
-  std::stack<Token> operators;
+  std::vector<std::string> symbols;
+  if (!settings.nostdlib)
+  {
+    symbols = readSymbolTable(settings.std_dir + "/" DC_STD_NAME ".sym", " (compile with --nostdlib to build without standard library)");
+  }
 
-  int i = 0;
-  Token token = expr.at(i);
-  while (i < expr.size())
+  if (linksIOLibrary(settings))
+  {
+    std::vector<std::string> io = readSymbolTable(settings.std_dir + "/" DC_IO_NAME ".sym", " (build it with --build-io)");
+    symbols.insert(symbols.end(), io.begin(), io.end());
+  }
+  return symbols;
+}
+
+std::string formatSymbol(const std::string &name, FunctionType *fnType)
+{
+  std::string symbol = name + " " + getTypeName(fnType->getReturnType());
+  for (Type *type : fnType->params())
+  {
+    symbol += " " + getTypeName(type);
+  }
+  if (fnType->isVarArg())
   {
-    token = expr.at(i);
-    if (token.type == TokenType::LITERAL)
+    symbol += " vararg";
+  }
+  return symbol;
+}
+
+std::vector<std::string> getModuleSymbols(Module &module)
+{
+  std::vector<std::string> symbols;
+  for (Function &fn : module)
+  {
+    if (fn.isIntrinsic() || fn.hasLocalLinkage())
     {
-      if (token.value.at(0) != '\'')
-      {
-        values.push(ConstantInt::get(preferred_type, std::stoi(token.value)));
-      }
-      else
-      {
-        values.push(ConstantInt::get(preferred_type, token.value.at(1) - '0'));
-      }
+      continue;
     }
-    else if (token.type == TokenType::IDENTIFIER)
+
+    symbols.push_back(formatSymbol(fn.getName().str(), fn.getFunctionType()));
+  }
+  return symbols;
+}
+
+void writeSymbolTable(Module &module, const std::string &filename)
+{
+  std::ofstream file(filename);
+  if (!file)
+  {
+    fatalError("failed to open " + filename);
+  }
+
+  for (std::string &symbol : getModuleSymbols(module))
+  {
+    file << symbol << "\n";
+  }
+}
+
+std::string getContextKey(std::string_view name)
+{
+  if (name.starts_with("_Z"))
+  {
+    return demangleCtxName(std::string(name));
+  }
+  return deleteDigits(replaceAll(std::string(name), "_", ""));
+}
+
+Value *ModuleCompiler::convertValue(Value *value, Type *type)
+{
+  if (type == nullptr || value->getType() == type)
+  {
+    return value;
+  }
+
+  Value *res = castValue(value, type);
+  if (res == nullptr)
+  {
+    compilationError("Can not convert " + getTypeName(value->getType()) + " to " + getTypeName(type));
+  }
+  return res;
+}
+
+Value *ModuleCompiler::lowerExpr(DCFunction &fn, const DCExpr &expr, Type *type)
+{
+  switch (expr.kind)
+  {
+  case EX_NUMBER:
+  {
+    // Without a type to take, a literal is an i32 or, when it does not fit one, an i64
+    Type *literalType = type;
+    if (literalType == nullptr || !literalType->isIntegerTy())
     {
-      DCVariable *tmp = getVarFromFunction(functions.back(), token.value);
-      values.push(builder.CreateLoad(preferred_type, tmp->llvmVar));
+      literalType = expr.value >= INT32_MIN && expr.value <= INT32_MAX ? builder->getInt32Ty() : builder->getInt64Ty();
     }
-    else if (token.type == TokenType::OPERATOR)
+    return convertValue(ConstantInt::get(literalType, expr.value, true), type);
+  }
+  case EX_CHAR:
+  {
+    std::string text = parseEscapeSequences(std::string(expr.token.value.substr(1, expr.token.value.size() - 2)));
+    return convertValue(builder->getInt8(text.empty() ? 0 : text.at(0)), type);
+  }
+  case EX_STRING:
+  {
+    std::string text = parseEscapeSequences(std::string(expr.token.value.substr(1, expr.token.value.size() - 2)));
+    return convertValue(builder->CreateGlobalStringPtr(text, "", 0U, fmodule.get()), type);
+  }
+  case EX_VARIABLE:
+  {
+    DCVariable *var = getVarFromFunction(fn, expr.token);
+    return convertValue(builder->CreateLoad(var->llvmType, var->llvmVar), type);
+  }
+  case EX_BINARY:
+  {
+    // Both operands are computed in the type of the result, pointers take part as 64 bit integers
+    Type *opType = type;
+    if (opType != nullptr && !opType->isIntegerTy())
     {
-      while (!operators.empty() && operators.top().type == TokenType::OPERATOR && ((token.value == "+" || token.value == "-" || token.value == "*" || token.value == "/") && (operators.top().value == "*" || operators.top().value == "/")))
-      {
-        Value *operand2 = values.top();
-        values.pop();
-        Value *operand1 = values.top();
-        values.pop();
-
-        Value *oper_res = perform_LLVM_operation(operand1, operand2, token.value.at(0));
-        if (oper_res == nullptr)
-        {
-          compilationError("Failed to perform LLVM Operation");
-        }
-
-        values.push(oper_res);
-        operators.pop();
-      }
-      operators.push(token);
+      opType = builder->getInt64Ty();
     }
-    else if (token.type == TokenType::LPAREN)
+
+    Value *lhs = lowerExpr(fn, *expr.lhs, opType);
+    if (opType == nullptr)
     {
-      operators.push(token);
+      opType = lhs->getType()->isIntegerTy() ? lhs->getType() : builder->getInt64Ty();
+      lhs = convertValue(lhs, opType);
     }
-    else if (token.type == TokenType::RPAREN)
+    Value *rhs = lowerExpr(fn, *expr.rhs, opType);
+
+    Value *res = nullptr;
+    switch (expr.token.value.at(0))
     {
-      while (!operators.empty() && operators.top().type != TokenType::LPAREN)
-      {
-        Value *operand2 = values.top();
-        values.pop();
-        Value *operand1 = values.top();
-        values.pop();
-
-        Value *oper_res = perform_LLVM_operation(operand1, operand2, operators.top().value.at(0));
-        if (oper_res == nullptr)
-        {
-          compilationError("Failed to perform LLVM Operation");
-        }
-
-        values.push(oper_res);
-        operators.pop();
-      }
-      operators.pop();
+    case '+':
+      res = builder->CreateAdd(lhs, rhs);
+      break;
+    case '-':
+      res = builder->CreateSub(lhs, rhs);
+      break;
+    case '*':
+      res = builder->CreateMul(lhs, rhs);
+      break;
+    case '/':
+      res = builder->CreateSDiv(lhs, rhs);
+      break;
+    case '%':
+      res = builder->CreateSRem(lhs, rhs);
+      break;
+    default:
+      compilationError("Failed to perform LLVM Operation");
     }
-    i++;
+    return convertValue(res, type);
   }
+  default:
+    compilationError("Comparison outside of an if statement");
+    return nullptr;
+  }
+}
 
-  while (!operators.empty())
+Value *ModuleCompiler::lowerCondition(DCFunction &fn, const DCExpr &expr)
+{
+  Value *LHS = lowerExpr(fn, *expr.lhs, nullptr);
+  Value *RHS = lowerExpr(fn, *expr.rhs, LHS->getType());
+
+  std::string_view op = expr.token.value;
+  if (op == "==")
+  {
+    return builder->CreateICmpEQ(LHS, RHS);
+  }
+  else if (op == "!=")
   {
+    return builder->CreateICmpNE(LHS, RHS);
+  }
+  else if (op == ">")
+  {
+    return builder->CreateICmpSGT(LHS, RHS);
+  }
+  else if (op == "<")
+  {
+    return builder->CreateICmpSLT(LHS, RHS);
+  }
+  else if (op == ">=")
+  {
+    return builder->CreateICmpSGE(LHS, RHS);
+  }
+  else if (op == "<=")
+  {
+    return builder->CreateICmpSLE(LHS, RHS);
+  }
+
+  compilationError("Invalid operator in IF Statement");
+  return nullptr;
+}
 
-    Value *operand2 = values.top();
-    values.pop();
-    Value *operand1 = values.top();
-    values.pop();
+bool ModuleCompiler::isTerminated()
+{
+  return builder->GetInsertBlock()->getTerminator() != nullptr;
+}
+
+void ModuleCompiler::lowerBlock(DCFunction &fn, const std::vector<DCStmt> &body)
+{
+  for (size_t i = 0; i < body.size(); i++)
+  {
+    // The return right after a tail call is lowered together with it
+    bool tail = i + 1 < body.size() && isTailCall(fn, body.at(i), body.at(i + 1));
+    lowerStatement(fn, body.at(i), tail);
+    i += tail;
+  }
+}
 
-    Value *oper_res = perform_LLVM_operation(operand1, operand2, operators.top().value.at(0));
-    if (oper_res == nullptr)
+void ModuleCompiler::lowerIf(DCFunction &fn, const DCStmt &stmt)
+{
+  /*
+    every arm tests its condition in the false block of the previous one:
+
+    compare 1, jump to true1 or false1
+    true1: ... jump merge
+    false1: compare 2, jump to true2 or false2
+    true2: ... jump merge
+    false2: else body, jump merge
+    merge:
+  */
+  BasicBlock *mergeBlock = BasicBlock::Create(*context, "merge");
+  for (const DCIfArm &arm : stmt.arms)
+  {
+    if (arm.condition == nullptr)
     {
-      compilationError("Failed to perform LLVM Operation");
+      lowerBlock(fn, arm.body);
+      break;
     }
 
-    values.push(oper_res);
-    operators.pop();
+    errorLine = stmt.line;
+    Value *cmpRes = lowerCondition(fn, *arm.condition);
+    BasicBlock *trueBlock = BasicBlock::Create(*context, "true", fn.fn);
+    BasicBlock *falseBlock = BasicBlock::Create(*context, "false", fn.fn);
+    builder->CreateCondBr(cmpRes, trueBlock, falseBlock);
+
+    builder->SetInsertPoint(trueBlock);
+    lowerBlock(fn, arm.body);
+    if (!isTerminated())
+    {
+      builder->CreateBr(mergeBlock);
+    }
+    builder->SetInsertPoint(falseBlock);
   }
 
-  return values.top();
+  if (!isTerminated())
+  {
+    builder->CreateBr(mergeBlock);
+  }
+  mergeBlock->insertInto(fn.fn);
+  builder->SetInsertPoint(mergeBlock);
 }
 
-Value *parseExpr(Type *preferred_type, bool rewind, std::string stopExprValue)
+// The hints of a loop as llvm.loop metadata, nullptr without hints
+MDNode *ModuleCompiler::getLoopMetadata(const DCStmt &stmt)
 {
-  int old_pos = g_lexer->iterIndex;
-  Token token = g_lexer->next();
-  std::vector<Token> expr_tokens = {};
-  Value *res = nullptr;
-
-  Type *ty = preferred_type;
-  if (ty == nullptr)
+  if (stmt.unroll == 0 && !stmt.vectorize)
   {
-    ty = builder.getInt32Ty();
+    return nullptr;
   }
 
-  while (token.type != TokenType::END && token.type != TokenType::SEMICOLON && token.value != "==" && token.value != "!=" && token.value != "->" && token.value != ">" && token.value != "<" && token.value != "<=" && token.value != ">=" && token.value != stopExprValue)
+  // The first operand of a loop ID refers to the node itself
+  SmallVector<Metadata *, 3> hints = {nullptr};
+  if (stmt.unroll > 0)
   {
-    expr_tokens.push_back(token);
-
-    token = g_lexer->next();
+    hints.push_back(MDNode::get(*context, {MDString::get(*context, "llvm.loop.unroll.count"), ConstantAsMetadata::get(builder->getInt32(stmt.unroll))}));
   }
-  if (expr_tokens.size() == 1) // if only single token in entire expression
+  if (stmt.vectorize)
   {
-    token = expr_tokens.at(0);
-    std::string eq = token.value;
-    if (token.type == TokenType::IDENTIFIER)
-    {
-      DCVariable *assignToVar = getVarFromFunction(functions.back(), eq);
+    hints.push_back(MDNode::get(*context, {MDString::get(*context, "llvm.loop.vectorize.enable"), ConstantAsMetadata::get(builder->getTrue())}));
+  }
 
-      Value *tmp = nullptr;
-      tmp = builder.CreateLoad(assignToVar->llvmType, assignToVar->llvmVar);
-      res = tmp;
-      ty = assignToVar->llvmType;
-      // builder.CreateStore(tmp, assignVar->llvmVar);
-    }
-    else if (token.type == TokenType::LITERAL)
-    {
-      if (eq.at(0) == '\'')
-      {
-        // builder.CreateStore(builder.getInt8(eq.at(1)), assignVar->llvmVar);
-        res = builder.getInt8(eq.at(1));
-        ty = builder.getInt8Ty();
-      }
-      else if (eq.at(0) >= '0' && eq.at(0) <= '9')
-      {
-        Constant *cnst = ConstantInt::get(ty, std::stoi(eq));
-        // builder.CreateStore(cnst, );
-        res = cnst;
-      }
-    }
+  MDNode *loopID = MDNode::getDistinct(*context, hints);
+  loopID->replaceOperandWith(0, loopID);
+  return loopID;
+}
+
+void ModuleCompiler::lowerWhile(DCFunction &fn, const DCStmt &stmt)
+{
+  /*
+    a canonical loop the loop passes can work with:
+
+    preheader: jump header
+    header: compare, jump to body or exit
+    body: ... jump latch
+    latch: jump header, carries the hints
+    exit:
+  */
+  BasicBlock *headerBlock = BasicBlock::Create(*context, "loop_header", fn.fn);
+  BasicBlock *bodyBlock = BasicBlock::Create(*context, "loop_body", fn.fn);
+  BasicBlock *latchBlock = BasicBlock::Create(*context, "loop_latch");
+  BasicBlock *exitBlock = BasicBlock::Create(*context, "loop_exit");
+  builder->CreateBr(headerBlock);
+
+  builder->SetInsertPoint(headerBlock);
+  if (stmt.condition != nullptr)
+  {
+    builder->CreateCondBr(lowerCondition(fn, *stmt.condition), bodyBlock, exitBlock);
   }
   else
   {
-    res = evaluate_expression(expr_tokens, ty);
+    builder->CreateBr(bodyBlock);
   }
-  if (rewind)
+
+  builder->SetInsertPoint(bodyBlock);
+  lowerBlock(fn, stmt.body);
+  if (!isTerminated())
   {
-    g_lexer->iterIndex = old_pos;
+    builder->CreateBr(latchBlock);
   }
-  return res;
-}
 
-std::string getLabelID();
+  latchBlock->insertInto(fn.fn);
+  builder->SetInsertPoint(latchBlock);
+  BranchInst *backedge = builder->CreateBr(headerBlock);
+  if (MDNode *loopID = getLoopMetadata(stmt))
+  {
+    backedge->setMetadata(LLVMContext::MD_loop, loopID);
+  }
+
+  exitBlock->insertInto(fn.fn);
+  builder->SetInsertPoint(exitBlock);
+}
 
-bool hasBRorRET(BasicBlock &BB)
+// `f() -> x; return x;` and `f(); return;` return whatever the call returned
+bool ModuleCompiler::isTailCall(DCFunction &fn, const DCStmt &call, const DCStmt &ret)
 {
-  // Get the last instruction in the BasicBlock
-  Instruction *lastInst = BB.getTerminator();
-  if (lastInst == nullptr)
+  if (call.kind != ST_CALL || ret.kind != ST_RETURN || getContext(call.name.value) == nullptr)
+  {
     return false;
+  }
 
-  // Check if the last instruction is a BranchInst or ReturnInst
-  if (isa<BranchInst>(lastInst) || isa<ReturnInst>(lastInst))
+  // Anything else is left to ST_RETURN, which reports the mismatch
+  if (fn.fnType->getReturnType()->isVoidTy())
   {
-    return true; // The BasicBlock ends with BR or RET
+    return call.target.type == TokenType::END && ret.value == nullptr;
   }
-
-  return false; // The BasicBlock does not end with BR or RET
+  return call.target.type != TokenType::END && ret.value != nullptr && ret.value->kind == EX_VARIABLE && ret.value->token.symbol == call.target.symbol;
 }
 
-Value *cmpExpr(bool isElif = false)
+// memcopy, memfill and memcompare work on whole buffers, they are lowered to the memory intrinsics unless a context
+// of the same name is visible
+bool ModuleCompiler::lowerBuiltin(DCFunction &fn, const DCStmt &stmt)
 {
-  if (isElif)
+  std::string name(stmt.name.value);
+  if (name != "memcopy" && name != "memfill" && name != "memcompare")
   {
-    builder.SetInsertPoint(functions.back().ifstatements.back().falseBlock);
+    return false;
   }
-  Value *LHS = parseExpr();
 
-  Token op = g_lexer->tokens[g_lexer->iterIndex];
-
-  Value *RHS = parseExpr();
-
-  if (op.type != TokenType::OPERATOR)
+  if (stmt.args.size() != 3)
   {
-    compilationError("Non-operator token in IF statement");
+    compilationError("Wrong number of arguments to " + name);
+  }
+  if (name != "memcompare" && stmt.target.type != TokenType::END)
+  {
+    compilationError(name + " does not return a value");
   }
 
-  BasicBlock *trueBlock = BasicBlock::Create(context, Twine(getLabelID() + "true"), functions.back().fn);
-
-  BasicBlock *falseBlock = nullptr;
-  BasicBlock *mergeBlock = nullptr;
+  Value *dest = lowerExpr(fn, *stmt.args.at(0), builder->getPtrTy());
+  Value *size = lowerExpr(fn, *stmt.args.at(2), builder->getInt64Ty());
+  if (name == "memfill")
+  {
+    builder->CreateMemSet(dest, lowerExpr(fn, *stmt.args.at(1), builder->getInt8Ty()), size, MaybeAlign());
+    return true;
+  }
 
-  Value *cmpRes = nullptr;
+  Value *source = lowerExpr(fn, *stmt.args.at(1), builder->getPtrTy());
+  if (name == "memcopy")
+  {
+    // The buffers must not overlap
+    builder->CreateMemCpy(dest, MaybeAlign(), source, MaybeAlign(), size);
+    return true;
+  }
 
-  if (LHS->getType() != RHS->getType())
+  // There is no intrinsic for it, the backend still expands memcmp calls of small known sizes inline
+  FunctionCallee memcmp = fmodule->getOrInsertFunction("memcmp", FunctionType::get(builder->getInt32Ty(), {builder->getPtrTy(), builder->getPtrTy(), builder->getInt64Ty()}, false));
+  Value *res = builder->CreateCall(memcmp, {dest, source, size});
+  if (stmt.target.type != TokenType::END)
   {
-    RHS = castValue(RHS, LHS->getType());
+    DCVariable *tmp = getVarFromFunction(fn, stmt.target);
+    builder->CreateStore(convertValue(res, tmp->llvmType), tmp->llvmVar);
   }
+  return true;
+}
 
-  if (op.value == "==")
+void ModuleCompiler::lowerCall(DCFunction &fn, const DCStmt &stmt, bool tail)
+{
+  std::string fnName(stmt.name.value);
+  Function *callee = getContext(stmt.name.value);
+  if (callee == nullptr && lowerBuiltin(fn, stmt))
   {
-    cmpRes = builder.CreateICmpEQ(LHS, RHS);
+    return;
   }
-  else if (op.value == "!=")
+  if (callee == nullptr)
   {
-    cmpRes = builder.CreateICmpNE(LHS, RHS);
+    compilationError("Undefined reference to " + fnName);
   }
-  else if (op.value == ">")
+
+  FunctionType *fnType = callee->getFunctionType();
+  if (stmt.args.size() < fnType->getNumParams() || (stmt.args.size() > fnType->getNumParams() && !fnType->isVarArg()))
   {
-    cmpRes = builder.CreateICmpSGT(LHS, RHS);
+    compilationError("Wrong number of arguments to " + fnName);
   }
-  else if (op.value == "<")
+
+  std::vector<Value *> args = {};
+  for (size_t i = 0; i < stmt.args.size(); i++)
   {
-    cmpRes = builder.CreateICmpSLT(LHS, RHS);
+    if (i < fnType->getNumParams())
+    {
+      args.push_back(lowerExpr(fn, *stmt.args.at(i), fnType->getParamType(i)));
+      continue;
+    }
+
+    // Variadic arguments get the C promotions
+    Value *arg = lowerExpr(fn, *stmt.args.at(i), nullptr);
+    if (arg->getType()->isIntegerTy() && arg->getType()->getIntegerBitWidth() < 32)
+    {
+      arg = builder->CreateSExt(arg, builder->getInt32Ty());
+    }
+    args.push_back(arg);
   }
-  else if (op.value == ">=")
+
+  if (tail)
   {
-    cmpRes = builder.CreateICmpSGE(LHS, RHS);
+    // Nothing may come between a tail call and its return, the context is left before the callee runs
+    profileExit(fn);
   }
-  else if (op.value == "<=")
+  CallInst *call = builder->CreateCall(callee, args);
+  Value *res = call;
+  if (stmt.target.type != TokenType::END)
   {
-    cmpRes = builder.CreateICmpSLE(LHS, RHS);
+    if (fnType->getReturnType()->isVoidTy())
+    {
+      compilationError(fnName + " does not return a value");
+    }
+    DCVariable *tmp = getVarFromFunction(fn, stmt.target);
+    res = convertValue(res, tmp->llvmType);
+    if (!tail)
+    {
+      builder->CreateStore(res, tmp->llvmVar);
+    }
   }
 
-  if (cmpRes == nullptr)
+  if (!tail)
   {
-    compilationError("Invalid operator in IF Statement");
+    return;
   }
 
-  if (!isElif)
+  Type *retType = fn.fnType->getReturnType();
+  if (retType->isVoidTy())
   {
-    falseBlock = BasicBlock::Create(context, Twine(getLabelID() + "false"), functions.back().fn);
-    mergeBlock = BasicBlock::Create(context, Twine(getLabelID() + "merge"), functions.back().fn);
-    builder.CreateCondBr(cmpRes, trueBlock, falseBlock);
-    builder.SetInsertPoint(trueBlock);
+    builder->CreateRetVoid();
   }
   else
   {
-    /*
-
-      when we create an initalizer if we have three blocks:
-      true:
-      ...
-      false:
-      ...
-      merge:
-      basically everything else
+    res = convertValue(res, retType);
+    builder->CreateRet(res);
+  }
 
-      the first thing we wanna do is to copy the merge block addr from previous if/elif to the current elif
-      when we create an elif statement we should be inserting in false block of a previous if/elif
-      then we create a true and an empty false block
-      also if the previous if/elif is true, then we need to insert branch to merge to the true block
-    */
-    // trueBlock = BasicBlock::Create(context, "", functions.back().fn);
-    falseBlock = BasicBlock::Create(context, Twine(getLabelID() + "false"), functions.back().fn);
+  // The callee may not touch the frame it replaces. A callee with the caller's own prototype whose result is returned
+  // as is can always replace it, the backend guarantees that for musttail, anything else is only a hint
+  if (fn.frameEscapes)
+  {
+    return;
+  }
+  bool guaranteed = fnType == fn.fnType && !fnType->isVarArg() && callee->getCallingConv() == fn.fn->getCallingConv() && (retType->isVoidTy() || res == call);
+  call->setTailCallKind(guaranteed ? CallInst::TCK_MustTail : CallInst::TCK_Tail);
+}
 
-    mergeBlock = functions.back().ifstatements.back().mergeBlock;
+void ModuleCompiler::lowerStatement(DCFunction &fn, const DCStmt &stmt, bool tail)
+{
+  errorLine = stmt.line;
+  if (isTerminated())
+  {
+    // Code after a return is unreachable, it still needs a block to live in
+    builder->SetInsertPoint(BasicBlock::Create(*context, "unreachable", fn.fn));
+  }
 
-    builder.CreateCondBr(builder.CreateICmpEQ(LHS, RHS), trueBlock, falseBlock);
+  switch (stmt.kind)
+  {
+  case ST_DECLARE:
+  {
+    // Allocas stay in the entry block, where they can be promoted to registers
+    Type *varType = getTypeFromStr(stmt.type);
+    IRBuilder<> entry(&fn.fn->getEntryBlock(), fn.fn->getEntryBlock().begin());
+    Value *var = entry.CreateAlloca(varType, nullptr, StringRef(stmt.name.value));
+    fn.variables.try_emplace(stmt.name.symbol, DCVariable{varType, std::string(stmt.name.value), var, getElementTypeFromStr(stmt.type)});
+    break;
+  }
+  case ST_ASSIGN:
+  {
+    DCVariable *assignVar = getVarFromFunction(fn, stmt.name);
+    Type *strongType = stmt.type.empty() ? assignVar->llvmType : getTypeFromStr(stmt.type);
+    Value *res = lowerExpr(fn, *stmt.value, strongType);
+    if (stmt.ptrAssign)
+    {
+      builder->CreateStore(res, builder->CreateLoad(builder->getPtrTy(), assignVar->llvmVar));
+    }
+    else
+    {
+      builder->CreateStore(convertValue(res, assignVar->llvmType), assignVar->llvmVar);
+    }
+    break;
+  }
+  case ST_ADDRESS:
+  {
+    DCVariable *assignVar = getVarFromFunction(fn, stmt.name);
+    DCVariable *ptrTo = getVarFromFunction(fn, stmt.target);
+    builder->CreateStore(ptrTo->llvmVar, assignVar->llvmVar);
+    break;
+  }
+  case ST_DEREF:
+  {
+    DCVariable *toDerefVar = getVarFromFunction(fn, stmt.name);
+    DCVariable *destVar = getVarFromFunction(fn, stmt.target);
+    Value *res = builder->CreateLoad(destVar->llvmType, builder->CreateLoad(toDerefVar->llvmType, toDerefVar->llvmVar));
+    builder->CreateStore(res, destVar->llvmVar);
+    break;
+  }
+  case ST_RETURN:
+  {
+    Type *retType = fn.fnType->getReturnType();
+    if (stmt.value == nullptr)
+    {
+      if (!retType->isVoidTy())
+      {
+        compilationError("Missing return value");
+      }
+      profileExit(fn);
+      builder->CreateRetVoid();
+    }
+    else
+    {
+      if (retType->isVoidTy())
+      {
+        compilationError("Returning a value from a void context");
+      }
+      Value *res = lowerExpr(fn, *stmt.value, retType);
+      profileExit(fn);
+      builder->CreateRet(res);
+    }
+    break;
+  }
+  case ST_IF:
+    lowerIf(fn, stmt);
+    break;
+  case ST_ARRAY_LOAD:
+  case ST_ARRAY_STORE:
+  {
+    DCVariable *arrayVar = getVarFromFunction(fn, stmt.name);
+    if (!arrayVar->llvmType->isPointerTy())
+    {
+      compilationError(arrayVar->hardcodedName + " is not a pointer");
+    }
 
-    // br to merge if previous if/elif is true
+    Value *index = lowerExpr(fn, *stmt.index, nullptr);
+    if (!index->getType()->isIntegerTy())
+    {
+      compilationError("Array index has to be an integer");
+    }
+    Value *res = builder->CreateGEP(arrayVar->elementType, builder->CreateLoad(arrayVar->llvmType, arrayVar->llvmVar), index);
 
-    if (!hasBRorRET(*functions.back().ifstatements.back().trueBlock))
+    if (stmt.kind == ST_ARRAY_LOAD)
+    {
+      // The element is read as it is stored and converted like an assign would
+      DCVariable *storeVar = getVarFromFunction(fn, stmt.target);
+      builder->CreateStore(convertValue(builder->CreateLoad(arrayVar->elementType, res), storeVar->llvmType), storeVar->llvmVar);
+    }
+    else
     {
-      builder.SetInsertPoint(functions.back().ifstatements.back().trueBlock);
-      builder.CreateBr(mergeBlock); // merge block is the same all across the if statement, so that it's fine if we use
-                                    // the local one
+      builder->CreateStore(lowerExpr(fn, *stmt.value, arrayVar->elementType), res);
     }
+    break;
+  }
+  case ST_CALL:
+    lowerCall(fn, stmt, tail);
+    break;
+  case ST_WHILE:
+    lowerWhile(fn, stmt);
+    break;
+  }
+}
 
-    if (functions.back().ifstatements.back().elif)
+static bool takesAddress(const std::vector<DCStmt> &body)
+{
+  for (const DCStmt &stmt : body)
+  {
+    if (stmt.kind == ST_ADDRESS || takesAddress(stmt.body))
+    {
+      return true;
+    }
+    for (const DCIfArm &arm : stmt.arms)
     {
-      if (!hasBRorRET(*functions.back().ifstatements.back().falseBlock))
+      if (takesAddress(arm.body))
       {
-        builder.SetInsertPoint(functions.back().ifstatements.back().falseBlock);
-        builder.CreateBr(mergeBlock);
+        return true;
       }
     }
-    builder.SetInsertPoint(trueBlock);
-
-    /*
+  }
+  return false;
+}
 
-      now it should look like this:
+void ModuleCompiler::lowerContext(const DCContext &ctx, Function *ctxFn)
+{
+  errorLine = ctx.line;
+  BasicBlock *ctxBlock = BasicBlock::Create(*context, ctxFn->getName() + "_blk", ctxFn);
+  builder->SetInsertPoint(ctxBlock);
 
-      compare
-      jump to true1 or false1
+  DCFunction fn = {ctxFn->getFunctionType(), ctxFn, {}, takesAddress(ctx.body)};
+  for (size_t i = 0; i < ctx.params.size(); i++)
+  {
+    const DCParam &param = ctx.params.at(i);
+    Type *argType = ctxFn->getArg(i)->getType();
+    Value *var = builder->CreateAlloca(argType);
+    builder->CreateStore(ctxFn->getArg(i), var);
+    fn.variables.try_emplace(param.name.symbol, DCVariable{argType, std::string(param.name.value), var, getElementTypeFromStr(param.type)});
+  }
 
-      true 1:
-      ...
-      jump merge
+  profileEntry(fn);
+  lowerBlock(fn, ctx.body);
 
+  // Falling off the end of a context returns nothing, or zero like main does in C
+  if (!isTerminated())
+  {
+    profileExit(fn);
+    Type *retType = fn.fnType->getReturnType();
+    if (retType->isVoidTy())
+    {
+      builder->CreateRetVoid();
+    }
+    else
+    {
+      builder->CreateRet(Constant::getNullValue(retType));
+    }
+  }
+}
 
-      false 1:
-      ...
-      compare
-      jump to true2 or false2
+StructType *ModuleCompiler::getProfileSlotType()
+{
+  return StructType::get(builder->getInt64Ty(), builder->getInt64Ty());
+}
 
-      true 2:
-      ... << Insert point here
+void ModuleCompiler::profileEntry(DCFunction &fn)
+{
+  if (!instrument)
+  {
+    return;
+  }
 
-      false 2:
+  if (profileTable == nullptr)
+  {
+    profileTable = new GlobalVariable(*fmodule, builder->getPtrTy(), false, GlobalValue::InternalLinkage, ConstantPointerNull::get(builder->getPtrTy()),
+                                      "dc.profile.table", nullptr, threadLocalTables ? GlobalValue::GeneralDynamicTLSModel : GlobalValue::NotThreadLocal);
+    profileGetTable = Function::Create(FunctionType::get(builder->getPtrTy(), false), GlobalValue::InternalLinkage, "dc.profile.get_table", *fmodule);
+  }
 
-      merge:
+  // Slot 0 of a table links it to the table of the next thread
+  StructType *slotType = getProfileSlotType();
+  fn.profileSlot = builder->CreateConstInBoundsGEP1_64(slotType, builder->CreateCall(profileGetTable), profileNames.size() + 1);
+  profileNames.push_back(demangleCtxName(fn.fn->getName().str()));
 
-      == C Pseudocode
-      if(...){
+  Value *calls = builder->CreateStructGEP(slotType, fn.profileSlot, 0);
+  builder->CreateStore(builder->CreateAdd(builder->CreateLoad(builder->getInt64Ty(), calls), builder->getInt64(1)), calls);
+  fn.profileStart = builder->CreateIntrinsic(Intrinsic::readcyclecounter, {}, {});
+}
 
-      } else {
-        if(...){
+void ModuleCompiler::profileExit(DCFunction &fn)
+{
+  if (fn.profileSlot == nullptr)
+  {
+    return;
+  }
 
-        } else {
+  Value *cycles = builder->CreateStructGEP(getProfileSlotType(), fn.profileSlot, 1);
+  Value *elapsed = builder->CreateSub(builder->CreateIntrinsic(Intrinsic::readcyclecounter, {}, {}), fn.profileStart);
+  builder->CreateStore(builder->CreateAdd(builder->CreateLoad(builder->getInt64Ty(), cycles), elapsed), cycles);
+}
 
-        }
-      }
-    */
+/*
+  every thread allocates its table on the first entry into a context of the module and pushes it on a list, the tables
+  outlive their threads so the report the module registers as a destructor can sum them up when the program ends
+*/
+void ModuleCompiler::emitProfileRuntime()
+{
+  IRBuilder<> b(*context);
+  Type *ptrTy = b.getPtrTy();
+  Type *i64Ty = b.getInt64Ty();
+  StructType *slotType = getProfileSlotType();
+  uint64_t count = profileNames.size();
+
+  GlobalVariable *threads = new GlobalVariable(*fmodule, ptrTy, false, GlobalValue::InternalLinkage, ConstantPointerNull::get(b.getPtrTy()), "dc.profile.threads");
+  FunctionCallee calloc = fmodule->getOrInsertFunction("calloc", FunctionType::get(ptrTy, {i64Ty, i64Ty}, false));
+  FunctionCallee dprintf = fmodule->getOrInsertFunction("dprintf", FunctionType::get(b.getInt32Ty(), {b.getInt32Ty(), ptrTy}, true));
+
+  BasicBlock *entry = BasicBlock::Create(*context, "entry", profileGetTable);
+  BasicBlock *ready = BasicBlock::Create(*context, "ready", profileGetTable);
+  BasicBlock *attach = BasicBlock::Create(*context, "attach", profileGetTable);
+  BasicBlock *push = BasicBlock::Create(*context, "push", profileGetTable);
+  BasicBlock *pushed = BasicBlock::Create(*context, "pushed", profileGetTable);
+
+  b.SetInsertPoint(entry);
+  Value *table = b.CreateLoad(ptrTy, profileTable);
+  b.CreateCondBr(b.CreateIsNull(table), attach, ready);
+  b.SetInsertPoint(ready);
+  b.CreateRet(table);
+
+  b.SetInsertPoint(attach);
+  Value *created = b.CreateCall(calloc, {b.getInt64(count + 1), b.getInt64(DataLayout(fmodule.get()).getTypeAllocSize(slotType))});
+  b.CreateStore(created, profileTable);
+  Value *head = b.CreateLoad(ptrTy, threads);
+  b.CreateBr(push);
+
+  b.SetInsertPoint(push);
+  PHINode *next = b.CreatePHI(ptrTy, 2);
+  next->addIncoming(head, attach);
+  b.CreateStore(next, created);
+  Value *exchange = b.CreateAtomicCmpXchg(threads, next, created, MaybeAlign(), AtomicOrdering::SequentiallyConsistent, AtomicOrdering::SequentiallyConsistent);
+  next->addIncoming(b.CreateExtractValue(exchange, 0), push);
+  b.CreateCondBr(b.CreateExtractValue(exchange, 1), pushed, push);
+  b.SetInsertPoint(pushed);
+  b.CreateRet(created);
+
+  std::vector<Constant *> names;
+  for (std::string &name : profileNames)
+  {
+    names.push_back(b.CreateGlobalString(name, "dc.profile.name", 0, fmodule.get()));
   }
-  DCIfStatement ifst;
-  ifst.trueBlock = trueBlock;
-  ifst.falseBlock = falseBlock;
-  ifst.mergeBlock = mergeBlock;
-  ifst.elif = isElif;
+  ArrayType *namesType = ArrayType::get(ptrTy, count);
+  GlobalVariable *namesTable = new GlobalVariable(*fmodule, namesType, true, GlobalValue::InternalLinkage, ConstantArray::get(namesType, names), "dc.profile.names");
+  ArrayType *totalsType = ArrayType::get(slotType, count);
+  GlobalVariable *totals = new GlobalVariable(*fmodule, totalsType, false, GlobalValue::InternalLinkage, ConstantAggregateZero::get(totalsType), "dc.profile.totals");
+
+  // Every module of the program reports its own contexts, only the first one prints the header
+  GlobalVariable *printed = cast<GlobalVariable>(fmodule->getOrInsertGlobal("__dc_profile_printed", b.getInt8Ty()));
+  printed->setLinkage(GlobalValue::LinkOnceODRLinkage);
+  printed->setInitializer(b.getInt8(0));
+
+  Function *report = Function::Create(FunctionType::get(b.getVoidTy(), false), GlobalValue::InternalLinkage, "dc.profile.report", *fmodule);
+  BasicBlock *reportEntry = BasicBlock::Create(*context, "entry", report);
+  BasicBlock *header = BasicBlock::Create(*context, "header", report);
+  BasicBlock *sum = BasicBlock::Create(*context, "sum", report);
+  BasicBlock *nextThread = BasicBlock::Create(*context, "next_thread", report);
+  BasicBlock *sumSlot = BasicBlock::Create(*context, "sum_slot", report);
+  BasicBlock *threadDone = BasicBlock::Create(*context, "thread_done", report);
+  BasicBlock *print = BasicBlock::Create(*context, "print", report);
+  BasicBlock *printRow = BasicBlock::Create(*context, "print_row", report);
+  BasicBlock *printNext = BasicBlock::Create(*context, "print_next", report);
+  BasicBlock *reportDone = BasicBlock::Create(*context, "done", report);
+
+  b.SetInsertPoint(reportEntry);
+  b.CreateCondBr(b.CreateIsNull(b.CreateLoad(b.getInt8Ty(), printed)), header, sum);
+  b.SetInsertPoint(header);
+  b.CreateCall(dprintf, {b.getInt32(2), b.CreateGlobalStringPtr("%-32s %12s %16s %12s\n"), b.CreateGlobalStringPtr("context"),
+                         b.CreateGlobalStringPtr("calls"), b.CreateGlobalStringPtr("cycles"), b.CreateGlobalStringPtr("cycles/call")});
+  b.CreateStore(b.getInt8(1), printed);
+  b.CreateBr(sum);
+
+  b.SetInsertPoint(sum);
+  Value *first = b.CreateLoad(ptrTy, threads);
+  b.CreateBr(nextThread);
+
+  b.SetInsertPoint(nextThread);
+  PHINode *thread = b.CreatePHI(ptrTy, 2);
+  thread->addIncoming(first, sum);
+  b.CreateCondBr(b.CreateIsNull(thread), print, sumSlot);
+
+  b.SetInsertPoint(sumSlot);
+  PHINode *slot = b.CreatePHI(i64Ty, 2);
+  slot->addIncoming(b.getInt64(0), nextThread);
+  Value *from = b.CreateInBoundsGEP(slotType, thread, b.CreateAdd(slot, b.getInt64(1)));
+  Value *to = b.CreateInBoundsGEP(slotType, totals, slot);
+  for (unsigned field = 0; field < 2; field++)
+  {
+    Value *total = b.CreateStructGEP(slotType, to, field);
+    Value *value = b.CreateLoad(i64Ty, b.CreateStructGEP(slotType, from, field));
+    b.CreateStore(b.CreateAdd(b.CreateLoad(i64Ty, total), value), total);
+  }
+  Value *slotNext = b.CreateAdd(slot, b.getInt64(1));
+  slot->addIncoming(slotNext, sumSlot);
+  b.CreateCondBr(b.CreateICmpEQ(slotNext, b.getInt64(count)), threadDone, sumSlot);
+
+  b.SetInsertPoint(threadDone);
+  thread->addIncoming(b.CreateLoad(ptrTy, thread), threadDone);
+  b.CreateBr(nextThread);
+
+  b.SetInsertPoint(print);
+  PHINode *row = b.CreatePHI(i64Ty, 2);
+  row->addIncoming(b.getInt64(0), nextThread);
+  Value *rowTotals = b.CreateInBoundsGEP(slotType, totals, row);
+  Value *calls = b.CreateLoad(i64Ty, b.CreateStructGEP(slotType, rowTotals, 0));
+  b.CreateCondBr(b.CreateICmpEQ(calls, b.getInt64(0)), printNext, printRow);
+
+  b.SetInsertPoint(printRow);
+  Value *name = b.CreateLoad(ptrTy, b.CreateInBoundsGEP(ptrTy, namesTable, row));
+  Value *cycles = b.CreateLoad(i64Ty, b.CreateStructGEP(slotType, rowTotals, 1));
+  b.CreateCall(dprintf, {b.getInt32(2), b.CreateGlobalStringPtr("%-32s %12llu %16llu %12llu\n"), name, calls, cycles, b.CreateUDiv(cycles, calls)});
+  b.CreateBr(printNext);
+
+  b.SetInsertPoint(printNext);
+  Value *rowNext = b.CreateAdd(row, b.getInt64(1));
+  row->addIncoming(rowNext, printNext);
+  b.CreateCondBr(b.CreateICmpEQ(rowNext, b.getInt64(count)), reportDone, print);
+
+  b.SetInsertPoint(reportDone);
+  b.CreateRetVoid();
+
+  appendToGlobalDtors(*fmodule, report, 0);
+}
 
-  functions.back()
-      .ifstatements.push_back(ifst);
+FunctionType *ModuleCompiler::getContextType(const DCContext &ctx)
+{
+  std::vector<Type *> argTypes = {};
+  for (const DCParam &param : ctx.params)
+  {
+    argTypes.push_back(getTypeFromStr(param.type));
+  }
+  return FunctionType::get(getTypeFromStr(ctx.returnType), argTypes, false);
+}
 
-  return LHS;
+std::string ModuleCompiler::getContextName(const DCContext &ctx, FunctionType *ctxType)
+{
+  std::string ctxName(ctx.name.value);
+  if (ctx.nomangle)
+  {
+    return ctxName;
+  }
+  return mangleCtxName(ctxType->getReturnType(), std::vector<Type *>(ctxType->param_begin(), ctxType->param_end()), ctxName);
 }
 
-int label_id = 0;
-std::string getLabelID()
+FunctionType *ModuleCompiler::getExternType(const DCExtern &ext)
 {
-  label_id++;
-  return functions.back().fn->getName().str() + "Label" + std::to_string(label_id);
+  std::vector<Type *> fnTypes = {};
+  for (std::string_view param : ext.params)
+  {
+    fnTypes.push_back(getTypeFromStr(param));
+  }
+  return FunctionType::get(getTypeFromStr(ext.returnType), fnTypes, ext.vararg);
 }
+
 #pragma endregion
 
-void compile(Lexer &lexer, Settings &settings)
+ModuleCompiler::ModuleCompiler(Settings &settings)
 {
-  fmodule.setModuleIdentifier(replaceAll(settings.output_name, ".", "_"));
-  fmodule.setDataLayout("e-m:e-i64:64-n8:16:32:64-S128");
-  g_lexer = &lexer;
-  emitStandardLibrary();
+  context = std::make_unique<LLVMContext>();
+  builder = std::make_unique<IRBuilder<>>(*context);
+  fmodule = std::make_unique<Module>("dc", *context);
+  fmodule->setModuleIdentifier(replaceAll(settings.output_name, ".", "_"));
+  TargetMachine *targetMachine = getTargetMachine(settings);
+  fmodule->setTargetTriple(targetMachine->getTargetTriple().str());
+  fmodule->setDataLayout(targetMachine->createDataLayout());
+
+  // The JIT has no thread-local storage, --run counts every thread in one table
+  instrument = settings.instrument_contexts && !settings.build_std && !settings.build_io;
+  threadLocalTables = settings.compilation_level != CL_RUN;
+}
 
-  const DataLayout &dataLayout = fmodule.getDataLayout();
+// Collects the externs and contexts a file provides to the other files, in the symbol table format
+std::vector<std::string> ModuleCompiler::collectSymbols(DCFile &file)
+{
+  std::vector<std::string> symbols;
+  for (const DCExtern &ext : file.externs)
+  {
+    errorLine = ext.line;
+    symbols.push_back(formatSymbol(std::string(ext.name.value), getExternType(ext)));
+  }
 
-  Token token = lexer.next();
-  while (token.type != TokenType::END)
+  for (const DCContext &ctx : file.contexts)
   {
-    switch (token.type)
-    {
-    case TokenType::KEYWORD:
-      if (token.value == "extern")
-      { // extern instruction
-        Token ret = lexer.next();
-        catchAndExit(ret);
-        Token name = lexer.next();
-        catchAndExit(name);
-
-        std::vector<Type *> fnTypes;
-        bool vararg = false;
-        while (true)
-        {
-          Token arg = lexer.next();
-          if (arg.value == ";")
-          {
-            break;
-          }
-
-          if (arg.value == "vararg")
-          {
-            vararg = true;
-          }
-          else
-          {
-            fnTypes.push_back(getTypeFromStr(arg.value));
-          }
-        }
-
-        FunctionType *params = FunctionType::get(getTypeFromStr(ret.value), fnTypes, vararg);
-        fmodule.getOrInsertFunction(name.value, params);
-      }
-      else if (token.value == "context")
-      {
-        token = lexer.next();
-        catchAndExit(token);
-
-        if (token.type == TokenType::SEMICOLON)
-        {
-          verifyFunction(*functions.back().fn);
-          functions.pop_back();
-          break;
-        }
-
-        bool nomangle = false;
-        if (token.value == "#nomangle")
-        {
-          nomangle = true;
-          token = lexer.next();
-          catchAndExit(token);
-        }
-
-        std::string ctxName = token.value;
-        Type *retType = builder.getVoidTy();
-
-        std::vector<Type *> argTypes = {};
-        std::vector<std::string> argNames = {};
-        while (true)
-        {
-          token = lexer.next();
-          catchAndExit(token);
-
-          if (token.value == "->")
-          {
-            token = lexer.next();
-            catchAndExit(token);
-            retType = getTypeFromStr(token.value);
-            break;
-          }
-
-          if (token.type == TokenType::TYPE)
-          {
-            argTypes.push_back(getTypeFromStr(token.value));
-
-            token = lexer.next();
-            catchAndExit(token);
-
-            argNames.push_back(token.value);
-          }
-        }
-
-        if (!nomangle)
-        {
-          ctxName = mangleCtxName(retType, argTypes, ctxName);
-        }
-        FunctionType *ctxType = FunctionType::get(retType, argTypes, false);
-        Function *ctx = Function::Create(ctxType, Function::ExternalLinkage, ctxName, fmodule);
-
-        BasicBlock *ctxBlock = BasicBlock::Create(context, ctxName + "_blk", ctx);
-        builder.SetInsertPoint(ctxBlock);
-
-        functions.push_back({ctxType, ctx, ctxBlock, {}});
-        all_functions.push_back({ctxType, ctx, ctxBlock, {}});
-
-        auto fnArgs = ctx->arg_begin();
-        Value *arg = fnArgs++;
-        for (int i = 0; i < argNames.size(); i++)
-        {
-          std::string argName = argNames.at(i);
-          Type *argType = argTypes.at(i);
-          // functions.back().variables.push_back({argType, argName, arg, true});
-          Value *var = builder.CreateAlloca(argType);
-          builder.CreateStore(arg, var);
-          functions.back().variables.push_back({argType, argName, var});
-          arg = fnArgs++;
-        }
-      }
-      else if (token.value == "declare")
-      {
-        token = lexer.next();
-        catchAndExit(token);
+    errorLine = ctx.line;
+    FunctionType *ctxType = getContextType(ctx);
+    symbols.push_back(formatSymbol(getContextName(ctx, ctxType), ctxType));
+  }
+  return symbols;
+}
 
-        Type *varType = getTypeFromStr(token.value);
+DCModule ModuleCompiler::compile(DCFile &file, const std::vector<std::string> &symbols, size_t first, size_t last)
+{
+  std::optional<TimeRegion> codegenTime("codegen");
 
-        token = lexer.next();
-        catchAndExit(token);
+  // Every context of the file is declared, so the chunks lowered into other modules can be called
+  std::vector<Function *> contexts;
+  for (const DCContext &ctx : file.contexts)
+  {
+    errorLine = ctx.line;
+    FunctionType *ctxType = getContextType(ctx);
+    Function *ctxFn = Function::Create(ctxType, Function::ExternalLinkage, getContextName(ctx, ctxType), *fmodule);
+    indexContext(ctxFn);
+    contexts.push_back(ctxFn);
+  }
 
-        std::string varName = token.value;
+  for (const std::string &symbol : symbols)
+  {
+    declareSymbol(symbol);
+  }
 
-        Value *var = nullptr;
+  for (const DCExtern &ext : file.externs)
+  {
+    errorLine = ext.line;
+    fmodule->getOrInsertFunction(StringRef(ext.name.value), getExternType(ext));
+  }
 
-        token = lexer.next();
-        catchAndExit(token);
+  for (size_t i = first; i < last; i++)
+  {
+    lowerContext(file.contexts.at(i), contexts.at(i));
+  }
 
-        var = builder.CreateAlloca(varType, nullptr, varName);
+  if (!profileNames.empty())
+  {
+    emitProfileRuntime();
+  }
 
-        functions.back().variables.push_back({varType, varName, var});
-      }
-      else if (token.value == "return")
-      {
-        token = lexer.next();
-        catchAndExit(token);
-        if (token.type == TokenType::SEMICOLON)
-        {
-          builder.CreateRet(nullptr);
-        }
-        else
-        {
-          lexer.iterIndex--;
-          Value *res = parseExpr(functions.back().fnType->getReturnType());
-          if (res->getType() != functions.back().fnType->getReturnType())
-          {
-            // res = builder.CreateCast(Instruction::CastOps::BitCast, res, functions.back().fnType->getReturnType());
-            // res = builder.CreateBitCast(res, functions.back().fnType->getReturnType());
-            res = castValue(res, functions.back().fnType->getReturnType());
-          }
-          builder.CreateRet(res);
-        }
-      }
-      else if (token.value == "assign")
-      {
-        token = lexer.next();
-        catchAndExit(token);
-
-        Type *strongType = nullptr;
-        bool ptrAssign = false;
-        if (token.type == TokenType::TYPE)
-        {
-          if (token.value == "ptr")
-          {
-            ptrAssign = true;
-            token = lexer.next();
-            catchAndExit(token);
-
-            if (token.type != TokenType::TYPE)
-            {
-              compilationError("Explicit pointer assignment needs to have a type after ptr");
-            }
-          }
-          strongType = getTypeFromStr(token.value);
-          token = lexer.next();
-          catchAndExit(token);
-        }
-
-        std::string assignName = token.value;
-
-        DCVariable *assignVar = getVarFromFunction(functions.back(), assignName);
-        if (strongType == nullptr)
-        {
-          strongType = assignVar->llvmType;
-        }
-
-        token = lexer.next();
-        catchAndExit(token);
-
-        std::string op = token.value;
-        std::string eq = "";
-
-        if (op == "=")
-        {
-          // token = lexer.next();
-          // catchAndExit(token);
-          // eq = token.value;
-
-          Value *res = parseExpr(strongType);
-          if (res != nullptr)
-          {
-            if (!ptrAssign)
-            {
-              builder.CreateStore(res, assignVar->llvmVar);
-            }
-            else
-            {
-              builder.CreateStore(res, builder.CreateLoad(builder.getPtrTy(), assignVar->llvmVar));
-            }
-          }
-        }
-        else if (op == "->")
-        {
-          token = lexer.next();
-          catchAndExit(token);
-
-          if (token.type != TokenType::IDENTIFIER)
-          {
-            compilationError("Excepted identifier after -> in assign");
-          }
-          DCVariable *ptrTo = getVarFromFunction(functions.back(), token.value);
-
-          Type *ptrType = ptrTo->llvmType->getPointerTo();
-
-          // Value *ptr = builder.CreatePointerCast(ptrTo->llvmVar, ptrType);
-          Value *ptr = builder.CreateBitCast(ptrTo->llvmVar, ptrType);
-
-          builder.CreateStore(ptr, assignVar->llvmVar);
-        }
-        else
-        {
-          compilationError("Unknown operator: " + op);
-        } // TODO: Other operators
-      }
-      else if (token.value == "deref")
-      {
-        token = lexer.next();
-        catchAndExit(token);
+  codegenTime.reset();
+  addTimeCounter(TC_IR_INSTRUCTIONS, fmodule->getInstructionCount());
+
+  TimeRegion verifyTime("verify");
+  std::string broken;
+  raw_string_ostream brokenStream(broken);
+  if (verifyModule(*fmodule, &brokenStream))
+  {
+    fatalError("generated module is broken\n" + broken);
+  }
 
-        if (token.type != TokenType::IDENTIFIER)
-        {
-          compilationError("Excepted identifier after deref");
-        }
-        std::string toDeref = token.value;
+  builder.reset();
+  DCModule res;
+  res.context = std::move(context);
+  res.module = std::move(fmodule);
+  return res;
+}
 
-        token = lexer.next();
-        catchAndExit(token);
+DCModule compileModule(DCFile &file, Settings &settings, const std::vector<std::string> &symbols, size_t first, size_t last)
+{
+  return ModuleCompiler(settings).compile(file, symbols, first, last);
+}
 
-        if (token.type != TokenType::ARROW)
-        {
-          compilationError("Excepted -> after identifier in deref");
-        }
 
-        token = lexer.next();
-        catchAndExit(token);
+DCModule linkModules(std::vector<DCModule> &modules)
+{
+  // Every file was compiled in its own LLVMContext, the modules are moved into a single one through bitcode
+  TimeRegion linkTime("link modules");
+  DCModule linked;
+  linked.context = std::make_unique<LLVMContext>();
 
-        if (token.type != TokenType::IDENTIFIER)
-        {
-          compilationError("Excepted identifier after -> in deref");
-        }
+  for (DCModule &dcModule : modules)
+  {
+    SmallVector<char, 0> buffer;
+    raw_svector_ostream stream(buffer);
+    WriteBitcodeToFile(*dcModule.module, stream);
+    dcModule.module.reset();
+    dcModule.context.reset();
+
+    Expected<std::unique_ptr<Module>> parsed = parseBitcodeFile(MemoryBufferRef(StringRef(buffer.data(), buffer.size()), "dc"), *linked.context);
+    if (!parsed)
+    {
+      fatalError(toString(parsed.takeError()));
+    }
 
-        std::string dest = token.value;
+    if (linked.module == nullptr)
+    {
+      linked.module = std::move(*parsed);
+    }
+    else if (Linker::linkModules(*linked.module, std::move(*parsed)))
+    {
+      fatalError("failed to link modules");
+    }
+  }
 
-        DCVariable *toDerefVar = getVarFromFunction(functions.back(), toDeref);
-        DCVariable *destVar = getVarFromFunction(functions.back(), dest);
+  return linked;
+}
 
-        Value *res = builder.CreateLoad(destVar->llvmType, builder.CreateLoad(toDerefVar->llvmType, toDerefVar->llvmVar));
+// -flto objects are bitcode, they are linked with the standard library into one module that is optimized as a whole
+std::string linkBitcode(std::vector<std::string> &objects, Settings &settings)
+{
+  DCModule linked;
+  linked.context = std::make_unique<LLVMContext>();
+  std::vector<std::string> inputs = objects;
+  if (!settings.nostdlib)
+  {
+    inputs.push_back(settings.std_dir + "/" DC_STD_NAME ".bc");
+  }
+  if (linksIOLibrary(settings))
+  {
+    inputs.push_back(settings.std_dir + "/" DC_IO_NAME ".bc");
+  }
 
-        builder.CreateStore(res, destVar->llvmVar);
-      }
-      else if (token.value == "if")
-      {
-        Value *res = cmpExpr();
-      }
-      else if (token.value == "else")
+  {
+    TimeRegion linkTime("link bitcode");
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+      std::unique_ptr<MemoryBuffer> buffer = readFile(inputs.at(i));
+      Expected<std::unique_ptr<Module>> parsed = parseBitcodeFile(buffer->getMemBufferRef(), *linked.context);
+      if (!parsed)
       {
-        if (!hasBRorRET(*functions.back().ifstatements.back().mergeBlock))
-        {
-          builder.CreateBr(functions.back().ifstatements.back().mergeBlock);
-        }
-        builder.SetInsertPoint(functions.back().ifstatements.back().falseBlock);
+        fatalError(inputs.at(i) + ": " + toString(parsed.takeError()));
       }
-      else if (token.value == "elif")
+
+      // Only the parts of the libraries the program uses are pulled in
+      unsigned flags = i < objects.size() ? Linker::Flags::None : Linker::Flags::LinkOnlyNeeded;
+      if (linked.module == nullptr)
       {
-        Value *res = cmpExpr(true);
+        linked.module = std::move(*parsed);
       }
-      else if (token.value == "fi")
+      else if (Linker::linkModules(*linked.module, std::move(*parsed), flags))
       {
-        if (!hasBRorRET(*functions.back().ifstatements.back().mergeBlock))
-        {
-          builder.CreateBr(functions.back().ifstatements.back().mergeBlock);
-        }
-        builder.SetInsertPoint(functions.back().ifstatements.back().falseBlock);
-        if (!hasBRorRET(*functions.back().ifstatements.back().falseBlock))
-        {
-          builder.CreateBr(functions.back().ifstatements.back().mergeBlock);
-        }
-
-        builder.SetInsertPoint(functions.back().ifstatements.back().mergeBlock);
-        // functions.back().ifstatements.pop_back();
-
-        functions.back().ifstatements.back().mergeBlock->moveAfter(&functions.back().fn->back());
-
-        BasicBlock *mergeBlock = functions.back().ifstatements.back().mergeBlock;
-
-        auto newEnd = std::remove_if(functions.back().ifstatements.begin(), functions.back().ifstatements.end(),
-                                     [mergeBlock](DCIfStatement &s)
-                                     {
-                                       return s.mergeBlock == mergeBlock;
-                                     });
-
-        functions.back().ifstatements.erase(newEnd, functions.back().ifstatements.end());
-
-        if (functions.back().ifstatements.size() > 0)
-        {
-          builder.SetInsertPoint(mergeBlock);
-          builder.CreateBr(functions.back().ifstatements.back().mergeBlock);
-        }
+        fatalError("failed to link " + inputs.at(i));
       }
-      else if (token.value == "array")
-      {
-        token = lexer.next();
-        catchAndExit(token);
-
-        if (token.type != TokenType::IDENTIFIER)
-          compilationError("Excepted identifier after keyword array");
-
-        DCVariable *arrayVar = getVarFromFunction(functions.back(), token.value);
-
-        Value *index = parseExpr(nullptr, false, "=");
-
-        Value *res = builder.CreateGEP(arrayVar->llvmType, builder.CreateLoad(arrayVar->llvmType, arrayVar->llvmVar), index);
-
-        token = lexer.tokens[lexer.iterIndex];
-
-        if (token.type == TokenType::ARROW)
-        {
-          token = lexer.next();
-          catchAndExit(token);
-          if (token.type != TokenType::IDENTIFIER)
-            compilationError("Excepted identifier in array after ->");
-
-          DCVariable *storeVar = getVarFromFunction(functions.back(), token.value);
+    }
+  }
 
-          builder.CreateStore(builder.CreateLoad(storeVar->llvmType, res), storeVar->llvmVar);
-        }
-        else if (token.type == TokenType::OPERATOR)
-        {
-          Value *storeVar = parseExpr();
-          builder.CreateStore(storeVar, res);
-        }
-        else
-        {
-          compilationError("Unsupported token in array after identifier");
-        }
-      }
+  // Nothing but main is called from outside the program, every other context can be inlined and dropped
+  internalizeModule(*linked.module, [](const GlobalValue &value)
+                    { return value.getName() == "main"; });
+  optimizeLinkedModule(*linked.module, settings);
 
-      break;
-    case TokenType::IDENTIFIER:
-      std::string identifier = token.value;
-      token = lexer.next();
-      catchAndExit(token);
+  std::string object = settings.output_name + ".lto.o";
+  emitFile(*linked.module, settings, object, CodeGenFileType::ObjectFile);
+  return object;
+}
 
-      if (token.type == TokenType::LPAREN) // function call
-      {
-        std::string fnName = identifier;
-        std::vector<Value *> args = {};
-
-        while (true)
-        {
-          token = lexer.next();
-          catchAndExit(token);
-
-          if (token.type == TokenType::SEMICOLON || token.type == TokenType::RPAREN)
-          {
-            break;
-          }
-
-          if (token.type == TokenType::COMMA)
-            continue;
-
-          if (token.type == TokenType::STRING_LITERAL)
-          {
-            std::string text = token.value;
-            if (text.at(0) == '"')
-            {
-              text.erase(text.begin());
-              text.erase(text.end() - 1);
-            }
-            args.push_back(builder.CreateGlobalStringPtr(parseEscapeSequences(text), "", 0U, &fmodule));
-          }
-          else if (token.type == TokenType::LITERAL)
-          {
-            if (token.value.at(0) == '\'')
-            {
-              Constant *cnst = ConstantInt::get(builder.getInt8Ty(), token.value.at(1));
-              args.push_back(cnst);
-            }
-            else if (token.value.at(0) >= '0' && token.value.at(0) <= '9')
-            {
-              Constant *cnst = ConstantInt::get(builder.getInt32Ty(), std::stoi(token.value));
-              args.push_back(cnst);
-            }
-          }
-          else if (token.type == TokenType::IDENTIFIER)
-          {
-            DCVariable *varFromFn = getVarFromFunction(functions.back(), token.value);
-
-            Value *var = builder.CreateLoad(varFromFn->llvmType, varFromFn->llvmVar);
-            args.push_back(var);
-          }
-        }
-
-        std::string mangled = getMangledName(fnName);
-        Function *fn = fmodule.getFunction(mangled);
-        if (fn == nullptr)
-        {
-          compilationError("Undefined reference to " + fnName);
-        }
-
-        Value *res = builder.CreateCall(fn, args);
-
-        if (token.type == TokenType::RPAREN)
-        {
-          token = lexer.next();
-          catchAndExit(token);
-
-          if (token.type == TokenType::ARROW)
-          {
-            token = lexer.next();
-            catchAndExit(token);
-
-            DCVariable *tmp = getVarFromFunction(functions.back(), token.value);
-            builder.CreateStore(res, tmp->llvmVar);
-          }
-        }
-      }
-      break;
+int linkExecutable(std::vector<std::string> &objects, Settings &settings)
+{
+  if (settings.lto)
+  {
+    std::string object = linkBitcode(objects, settings);
+    for (std::string &bitcode : objects)
+    {
+      remove(bitcode.c_str());
     }
-    token = lexer.next();
+    objects = {object};
   }
 
   std::string rawFileName = settings.output_name;
-  std::string llcargs = "";
   std::string ccargs = "";
-  if (settings.pic == true)
+  if (!settings.nostdlib && !settings.lto)
+  {
+    ccargs += settings.std_dir + "/" DC_STD_NAME ".o ";
+  }
+  if (linksIOLibrary(settings) && !settings.lto)
   {
-    llcargs = llcargs + "-relocation-model=pic";
+    ccargs += settings.std_dir + "/" DC_IO_NAME ".a ";
+  }
+
+  if (settings.profile_generate)
+  {
+    // Links the profile runtime the instrumentation calls into
+    ccargs += "-fprofile-instr-generate ";
   }
 
   if (!settings.libs.empty())
@@ -1217,62 +1580,318 @@ void compile(Lexer &lexer, Settings &settings)
     }
   }
 
-  verifyModule(fmodule);
+  TimeRegion linkTime("link");
+  std::string cc_command = "cc ";
+  for (std::string &object : objects)
+  {
+    cc_command += object + " ";
+  }
+  cc_command += "-o " + rawFileName + " -g " + ccargs;
 
-  std::error_code EC;
-  raw_fd_ostream dest(rawFileName + ".ll", EC);
-  if (EC)
+  int exitcode = system(cc_command.c_str());
+  if (exitcode != 0)
   {
-    std::cout << "\x1b[1mdcc:\x1b[0m \x1b[1;31mfatal error:\x1b[0m failed to open " << rawFileName + ".ll" << ": " << EC << "\n";
-    exit(1);
+    fatalError("failed to compile object (exit code: " + std::to_string(exitcode) + ")");
   }
 
-  fmodule.print(dest, nullptr);
-  if (settings.compilation_level == CL_IR)
+  for (std::string &object : objects)
   {
-    return;
+    remove(object.c_str());
   }
-  std::string cc_command = "cc " + rawFileName + ".o -o " + rawFileName + " -g " + ccargs;
-  std::string llc_command = "llc " + rawFileName + ".ll -o " + rawFileName + ".s " + llcargs;
-  std::string as_command = "as " + rawFileName + ".s -o " + rawFileName + ".o";
+  return 0;
+}
 
-  int exitcode = 0;
-  exitcode = system(llc_command.c_str());
-  if (exitcode != 0)
+int emitModule(DCModule &program, Settings &settings)
+{
+  std::string rawFileName = settings.output_name;
+
+  optimizeModule(*program.module, settings);
+
+  if (settings.compilation_level == CL_RUN)
   {
-    std::cout << "\x1b[1mdcc:\x1b[0m \x1b[1;31mfatal error:\x1b[0m failed to compile IR (exit code: " << exitcode << ")\n";
-    exit(1);
+    return runModule(std::move(program.module), std::move(program.context), settings);
+  }
+
+  if (settings.compilation_level == CL_IR)
+  {
+    std::error_code EC;
+    raw_fd_ostream dest(rawFileName + ".ll", EC);
+    if (EC)
+    {
+      fatalError("failed to open " + rawFileName + ".ll: " + EC.message());
+    }
+
+    TimeRegion emitTime("emit");
+    program.module->print(dest, nullptr);
+    addTimeCounter(TC_EMITTED_BYTES, dest.tell());
+    return 0;
   }
 
   if (settings.compilation_level == CL_ASM)
   {
-    goto cleanupLevel1;
+    emitFile(*program.module, settings, rawFileName + ".s", CodeGenFileType::AssemblyFile);
+    return 0;
   }
 
-  exitcode = system(as_command.c_str());
-  if (exitcode != 0)
+  if (settings.lto && !settings.build_std && !settings.build_io)
   {
-    std::cout << "\x1b[1mdcc:\x1b[0m \x1b[1;31mfatal error:\x1b[0m failed to assemble (exit code: " << exitcode << ")\n";
-    exit(1);
+    emitBitcode(*program.module, rawFileName + ".o");
+    return 0;
   }
 
-  if (settings.compilation_level == CL_OBJ)
+  emitFile(*program.module, settings, rawFileName + ".o", CodeGenFileType::ObjectFile);
+  if (settings.build_io)
   {
-    goto cleanupLevel2;
+    emitArchive(rawFileName + ".o", rawFileName + ".a");
+    remove((rawFileName + ".o").c_str());
   }
+  if (settings.build_std || settings.build_io)
+  {
+    // Programs built with -flto link the bitcode instead of the object
+    emitBitcode(*program.module, rawFileName + ".bc");
+    writeSymbolTable(*program.module, rawFileName + ".sym");
+  }
+  return 0;
+}
 
-  exitcode = system(cc_command.c_str());
-  if (exitcode != 0)
+int CompilerInstance::compileProgram()
+{
+  bool buildLibrary = settings.build_std || settings.build_io;
+  size_t count = buildLibrary ? 1 : settings.filenames.size();
+  std::vector<std::string> stdSymbols = loadStandardLibrary(settings);
+  Cache cache(settings);
+
+  // Executables and single-file objects are emitted per file, everything else from a single linked module
+  bool perFileObjects = settings.compilation_level == CL_EXE || (settings.compilation_level == CL_OBJ && count == 1 && !buildLibrary);
+
+  std::vector<std::unique_ptr<MemoryBuffer>> sources(count);
+  std::vector<std::string> sourceKeys(count);
+  std::vector<std::unique_ptr<DCFile>> files(count);
+  std::vector<std::vector<std::string>> fileSymbols(count);
+
+  auto parse = [&](size_t i)
+  {
+    TimeRegion parseTime("parse");
+    Lexer lexer(sources.at(i)->getBuffer());
+    files.at(i) = std::make_unique<DCFile>(parseFile(lexer));
+    addTimeCounter(TC_TOKENS, lexer.count());
+  };
+
+  parallelFor(count, [&](size_t i)
+              {
+                {
+                  TimeRegion readTime("read");
+                  if (settings.build_std)
+                  {
+                    sources.at(i) = MemoryBuffer::getMemBuffer(dc_std_source, DC_STD_NAME, false);
+                  }
+                  else if (settings.build_io)
+                  {
+                    sources.at(i) = MemoryBuffer::getMemBuffer(dc_io_source, DC_IO_NAME, false);
+                  }
+                  else
+                  {
+                    sources.at(i) = readFile(settings.filenames.at(i));
+                  }
+                }
+
+                std::string cached;
+                if (cache.enabled)
+                {
+                  sourceKeys.at(i) = cache.hash({settings.output_name, sources.at(i)->getBuffer()});
+                  if (cache.load(sourceKeys.at(i), "sym", cached))
+                  {
+                    fileSymbols.at(i) = split(cached, "\n");
+                    fileSymbols.at(i).pop_back(); // every symbol ends with a newline
+                    return;
+                  }
+                }
+
+                parse(i);
+                {
+                  TimeRegion symbolsTime("collect symbols");
+                  fileSymbols.at(i) = ModuleCompiler(settings).collectSymbols(*files.at(i));
+                }
+
+                if (cache.enabled)
+                {
+                  for (std::string &symbol : fileSymbols.at(i))
+                  {
+                    cached += symbol + "\n";
+                  }
+                  cache.store(sourceKeys.at(i), "sym", cached);
+                } });
+
+  // Instrumented objects differ from plain ones, and objects optimized with a profile depend on what it contains
+  std::string profile = std::to_string(settings.profile_generate);
+  if (cache.enabled && !settings.profile_use.empty())
+  {
+    profile += readFile(settings.profile_use)->getBuffer().str();
+  }
+
+  std::vector<std::vector<std::string>> visibleSymbols(count);
+  std::vector<std::string> objects(count);
+  std::vector<std::string> objectKeys(count);
+  parallelFor(count, [&](size_t i)
+              {
+                std::vector<std::string> &symbols = visibleSymbols.at(i);
+                symbols = stdSymbols;
+                for (size_t j = 0; j < count; j++)
+                {
+                  if (j != i)
+                  {
+                    symbols.insert(symbols.end(), fileSymbols.at(j).begin(), fileSymbols.at(j).end());
+                  }
+                }
+
+                // The object depends on the source, on every symbol it can see and on the code generation settings
+                if (perFileObjects)
+                {
+                  objects.at(i) = count == 1 ? settings.output_name + ".o" : settings.output_name + "." + std::to_string(i) + ".o";
+                  if (cache.enabled)
+                  {
+                    std::string visible;
+                    for (std::string &symbol : symbols)
+                    {
+                      visible += symbol + "\n";
+                    }
+                    objectKeys.at(i) = cache.hash({sourceKeys.at(i), visible, getTargetMachine(settings)->getTargetTriple().str(),
+                                                   std::to_string(settings.opt_level), std::to_string(settings.pic), std::to_string(settings.lto), profile,
+                                                   std::to_string(settings.instrument_contexts)});
+                    if (cache.fetchFile(objectKeys.at(i), "o", objects.at(i)))
+                    {
+                      sources.at(i).reset();
+                      return;
+                    }
+                  }
+                }
+
+                if (files.at(i) == nullptr)
+                {
+                  parse(i);
+                } });
+
+  // Contexts of large files are split into chunks, every chunk is lowered into its own module on its own thread
+  typedef struct
+  {
+    size_t file;
+    size_t first;
+    size_t last;
+  } DCChunk;
+
+  std::vector<DCChunk> chunks;
+  for (size_t i = 0; i < count; i++)
+  {
+    if (files.at(i) == nullptr)
+    {
+      continue;
+    }
+
+    size_t contexts = files.at(i)->contexts.size();
+    size_t parts = std::max<size_t>(1, std::min<size_t>(contexts / CHUNK_CONTEXTS, getWorkerCount(contexts)));
+    for (size_t part = 0; part < parts; part++)
+    {
+      chunks.push_back({i, contexts * part / parts, contexts * (part + 1) / parts});
+    }
+  }
+
+  std::vector<DCModule> chunkModules(chunks.size());
+  parallelFor(chunks.size(), [&](size_t c)
+              {
+                DCChunk &chunk = chunks.at(c);
+                chunkModules.at(c) = compileModule(*files.at(chunk.file), settings, visibleSymbols.at(chunk.file), chunk.first, chunk.last);
+              });
+  files.clear();
+  sources.clear();
+
+  std::vector<std::vector<DCModule>> modules(count);
+  for (size_t c = 0; c < chunks.size(); c++)
+  {
+    modules.at(chunks.at(c).file).push_back(std::move(chunkModules.at(c)));
+  }
+
+  if (perFileObjects)
   {
-    std::cout << "\x1b[1mdcc:\x1b[0m \x1b[1;31mfatal error:\x1b[0m failed to compile object (exit code: " << exitcode << ")\n";
-    std::cout << "\x1b[1mdcc: note:\x1b[0m if you are using an ARM processor, try recompiling with --arm\n";
-    exit(1);
+    parallelFor(count, [&](size_t i)
+                {
+                  if (modules.at(i).empty())
+                  {
+                    return;
+                  }
+
+                  DCModule module = modules.at(i).size() == 1 ? std::move(modules.at(i).front()) : linkModules(modules.at(i));
+                  optimizeModule(*module.module, settings);
+                  if (settings.lto)
+                  {
+                    emitBitcode(*module.module, objects.at(i));
+                  }
+                  else
+                  {
+                    emitFile(*module.module, settings, objects.at(i), CodeGenFileType::ObjectFile);
+                  }
+                  module.module.reset();
+                  module.context.reset();
+
+                  if (cache.enabled)
+                  {
+                    cache.storeFile(objectKeys.at(i), "o", objects.at(i));
+                  } });
   }
 
-cleanupLevel3:
-  remove((rawFileName + ".o").c_str());
-cleanupLevel2:
-  remove((rawFileName + ".s").c_str());
-cleanupLevel1:
-  remove((rawFileName + ".ll").c_str());
+  cache.report(settings.cache_stats);
+
+  if (settings.compilation_level == CL_OBJ && perFileObjects)
+  {
+    return 0;
+  }
+
+  if (settings.compilation_level == CL_EXE)
+  {
+    return linkExecutable(objects, settings);
+  }
+
+  std::vector<DCModule> all;
+  for (std::vector<DCModule> &fileModules : modules)
+  {
+    for (DCModule &module : fileModules)
+    {
+      all.push_back(std::move(module));
+    }
+  }
+  DCModule program = all.size() == 1 ? std::move(all.front()) : linkModules(all);
+  return emitModule(program, settings);
+}
+
+CompilerInstance::CompilerInstance(Settings settings) : settings(std::move(settings)) {}
+
+int CompilerInstance::compile()
+{
+  lastError.reset();
+  try
+  {
+    return compileProgram();
+  }
+  catch (DCError &err)
+  {
+    lastError = err;
+    return 1;
+  }
+}
+
+const std::optional<DCError> &CompilerInstance::error() const
+{
+  return lastError;
+}
+
+int compile(Settings &settings)
+{
+  startTimeReport(settings);
+  CompilerInstance compiler(settings);
+  int exitcode = compiler.compile();
+  if (compiler.error())
+  {
+    printf("%s", compiler.error()->format().c_str());
+  }
+  printTimeReport(settings);
+  return exitcode;
 }
@@ -0,0 +1,371 @@
+#include <dc_io.hpp>
+
+// Compiled once at build time with `dcc --build-io` into an archive of its own,
+// programs that use it link it, also with --nostdlib
+const char *dc_io_source = R"(
+extern i64 write i32 ptr i64;
+extern i64 read i32 ptr i64;
+extern void exit i32;
+
+
+"Buffered I/O"
+
+"Calls nothing but read, write and exit, and the memcpy memcopy lowers to, and never allocates: the caller provides the"
+"state and the buffer. Writers keep output until their buffer is full or io_flush, readers refill theirs with a single"
+"read. Nothing is flushed at exit"
+"Writer: [0] buffer, [1] used, [2] capacity, [3] file descriptor, 32 bytes"
+"Reader: [0] buffer, [1] position, [2] filled, [3] capacity, [4] file descriptor, 40 bytes"
+
+"Reports like collapse does, straight to stderr"
+
+context io_fail str __desc -> void;
+declare i64 __size;
+declare i8 __c;
+
+assign __size = 0;
+array __desc 0 -> __c;
+while __c != 0;
+  assign __size = __size + 1;
+  array __desc __size -> __c;
+done;
+
+write(2, "Program collapsed: ", 19);
+write(2, __desc, __size);
+write(2, "\n", 1);
+exit(128);
+return;
+context;
+
+context io_write_all i64 __fd ptr __data i64 __size -> void;
+declare i64 __done;
+declare i64 __written;
+declare ptr __from;
+
+assign __done = 0;
+while __done < __size;
+  assign __from = __data + __done;
+  assign __written = __size - __done;
+  write(__fd, __from, __written) -> __written;
+  if __written < 1;
+    io_fail("[io_write] write failed");
+  fi;
+  assign __done = __done + __written;
+done;
+
+return;
+context;
+
+"The buffer has to hold the longest number io_write_int writes, 20 bytes. Returns -1 when it is smaller"
+
+context io_writer i64* __writer i32 __fd ptr __buffer i64 __size -> i32;
+
+if __size < 20;
+  return 0 - 1;
+fi;
+
+array __writer 0 = __buffer;
+array __writer 1 = 0;
+array __writer 2 = __size;
+array __writer 3 = __fd;
+
+return 0;
+context;
+
+context io_flush i64* __writer -> void;
+declare ptr __buffer;
+declare i64 __used;
+declare i64 __fd;
+
+array __writer 0 -> __buffer;
+array __writer 1 -> __used;
+array __writer 3 -> __fd;
+io_write_all(__fd, __buffer, __used);
+array __writer 1 = 0;
+
+return;
+context;
+
+context io_write i64* __writer ptr __data i64 __size -> void;
+declare i64 __used;
+declare i64 __capacity;
+declare i64 __free;
+declare i64 __fd;
+declare ptr __to;
+
+array __writer 1 -> __used;
+array __writer 2 -> __capacity;
+assign __free = __capacity - __used;
+if __size > __free;
+  io_flush(__writer);
+  assign __used = 0;
+
+  if __size >= __capacity;
+    array __writer 3 -> __fd;
+    io_write_all(__fd, __data, __size);
+    return;
+  fi;
+fi;
+
+array __writer 0 -> __to;
+assign __to = __to + __used;
+memcopy(__to, __data, __size);
+assign __used = __used + __size;
+array __writer 1 = __used;
+
+return;
+context;
+
+context io_write_str i64* __writer str __text -> void;
+declare i64 __size;
+declare i8 __c;
+
+assign __size = 0;
+array __text 0 -> __c;
+while __c != 0;
+  assign __size = __size + 1;
+  array __text __size -> __c;
+done;
+
+io_write(__writer, __text, __size);
+return;
+context;
+
+context io_write_char i64* __writer i8 __c -> void;
+declare i64 __used;
+declare i64 __capacity;
+declare i8* __buffer;
+
+array __writer 1 -> __used;
+array __writer 2 -> __capacity;
+if __used == __capacity;
+  io_flush(__writer);
+  assign __used = 0;
+fi;
+
+array __writer 0 -> __buffer;
+array __buffer __used = __c;
+assign __used = __used + 1;
+array __writer 1 = __used;
+
+return;
+context;
+
+"Formats straight into the buffer, digits are taken off the negative value so the smallest i64 is written too"
+
+context io_write_int i64* __writer i64 __value -> void;
+declare i64 __used;
+declare i64 __capacity;
+declare i8* __buffer;
+declare i64 __rest;
+declare i64 __digits;
+declare i64 __digit;
+declare i64 __end;
+
+array __writer 1 -> __used;
+array __writer 2 -> __capacity;
+assign __end = __used + 20;
+if __end > __capacity;
+  io_flush(__writer);
+  assign __used = 0;
+fi;
+array __writer 0 -> __buffer;
+
+assign __rest = __value;
+if __value < 0;
+  array __buffer __used = '-';
+  assign __used = __used + 1;
+else;
+  assign __rest = 0 - __value;
+fi;
+
+assign __digits = 1;
+assign __digit = __rest / 10;
+while __digit != 0;
+  assign __digits = __digits + 1;
+  assign __digit = __digit / 10;
+done;
+
+assign __used = __used + __digits;
+assign __end = __used;
+while __digits > 0;
+  assign __end = __end - 1;
+  assign __digit = __rest % 10;
+  array __buffer __end = '0' - __digit;
+  assign __rest = __rest / 10;
+  assign __digits = __digits - 1;
+done;
+array __writer 1 = __used;
+
+return;
+context;
+
+"Returns -1 when the buffer is empty"
+
+context io_reader i64* __reader i32 __fd ptr __buffer i64 __size -> i32;
+
+if __size < 1;
+  return 0 - 1;
+fi;
+
+array __reader 0 = __buffer;
+array __reader 1 = 0;
+array __reader 2 = 0;
+array __reader 3 = __size;
+array __reader 4 = __fd;
+
+return 0;
+context;
+
+"The next byte without consuming it, -1 at the end of the input"
+
+context io_peek_char i64* __reader -> i32;
+declare i64 __position;
+declare i64 __filled;
+declare i64 __capacity;
+declare i64 __fd;
+declare i8* __buffer;
+declare i32 __c;
+
+array __reader 0 -> __buffer;
+array __reader 1 -> __position;
+array __reader 2 -> __filled;
+if __position == __filled;
+  array __reader 3 -> __capacity;
+  array __reader 4 -> __fd;
+  read(__fd, __buffer, __capacity) -> __filled;
+  if __filled < 0;
+    io_fail("[io_read] read failed");
+  fi;
+  array __reader 1 = 0;
+  array __reader 2 = __filled;
+  if __filled == 0;
+    return 0 - 1;
+  fi;
+  assign __position = 0;
+fi;
+
+array __buffer __position -> __c;
+if __c < 0;
+  assign __c = __c + 256;
+fi;
+
+return __c;
+context;
+
+context io_read_char i64* __reader -> i32;
+declare i64 __position;
+declare i32 __c;
+
+io_peek_char(__reader) -> __c;
+if __c >= 0;
+  array __reader 1 -> __position;
+  assign __position = __position + 1;
+  array __reader 1 = __position;
+fi;
+
+return __c;
+context;
+
+"Skips whitespace and reads a decimal number, fails on anything else and on numbers that do not fit in an i64"
+
+context io_read_int i64* __reader -> i64;
+declare i32 __c;
+declare i64 __value;
+declare i64 __digit;
+declare i64 __digits;
+declare i64 __negative;
+declare i64 __min;
+declare i64 __limit;
+
+io_peek_char(__reader) -> __c;
+while __c <= ' ';
+  if __c < 0;
+    io_fail("[io_read_int] parse failed");
+  fi;
+  io_read_char(__reader) -> __c;
+  io_peek_char(__reader) -> __c;
+done;
+
+assign __negative = 0;
+if __c == '-';
+  assign __negative = 1;
+  io_read_char(__reader) -> __c;
+  io_peek_char(__reader) -> __c;
+fi;
+
+"Digits are accumulated as a negative number like parse_i64 does"
+assign __min = 0 - 9223372036854775807;
+assign __min = __min - 1;
+assign __value = 0;
+assign __digits = 0;
+assign __digit = __c - '0';
+if __digit > 9;
+  assign __digit = 0 - 1;
+fi;
+while __digit >= 0;
+  assign __limit = __min + __digit;
+  assign __limit = __limit / 10;
+  if __value < __limit;
+    io_fail("[io_read_int] out of range");
+  fi;
+  assign __value = __value * 10 - __digit;
+  assign __digits = __digits + 1;
+  io_read_char(__reader) -> __c;
+  io_peek_char(__reader) -> __c;
+  assign __digit = __c - '0';
+  if __digit > 9;
+    assign __digit = 0 - 1;
+  fi;
+done;
+
+if __digits == 0;
+  io_fail("[io_read_int] parse failed");
+fi;
+if __negative == 0;
+  if __value == __min;
+    io_fail("[io_read_int] out of range");
+  fi;
+  assign __value = 0 - __value;
+fi;
+
+return __value;
+context;
+
+"Skips whitespace and reads the next word into dest, at most size - 1 bytes and a terminating zero. Returns its length"
+
+context io_read_word i64* __reader i8* __dest i64 __size -> i64;
+declare i32 __c;
+declare i64 __length;
+
+if __size < 1;
+  return 0;
+fi;
+
+array __dest 0 = 0;
+io_peek_char(__reader) -> __c;
+while __c <= ' ';
+  if __c < 0;
+    return 0;
+  fi;
+  io_read_char(__reader) -> __c;
+  io_peek_char(__reader) -> __c;
+done;
+
+assign __length = 0;
+assign __size = __size - 1;
+while __c > ' ';
+  if __length == __size;
+    assign __c = 0;
+  else;
+    array __dest __length = __c;
+    assign __length = __length + 1;
+    io_read_char(__reader) -> __c;
+    io_peek_char(__reader) -> __c;
+  fi;
+done;
+array __dest __length = 0;
+
+return __length;
+context;
+
+)";
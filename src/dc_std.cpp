@@ -0,0 +1,266 @@
+#include <dc_std.hpp>
+
+// Compiled once at build time with `dcc --build-std`, user programs only see
+// the resulting symbol table and link against the object
+const char *dc_std_source = R"(
+extern i32 printf str vararg;
+extern i32 scanf str vararg;
+extern ptr malloc i64;
+extern void free ptr;
+extern void exit i32;
+extern i64 strtol str str* i32;
+
+
+"Collapses"
+
+context collapse_handler str desc -> void;
+
+printf("Program collapsed: %s\n", desc);
+
+exit(128);
+return;
+context;
+
+context collapse str desc -> void;
+
+collapse_handler(desc);
+
+return;
+context;
+
+
+"Memory Allocations"
+
+context alloc i64 __size -> ptr;
+declare ptr __ptr;
+
+malloc(__size) -> __ptr;
+
+if __ptr == 0;
+  collapse("Failed to allocate memory");
+fi;
+
+return __ptr;
+context;
+
+context delete ptr __ptr -> void;
+
+free(__ptr);
+
+return;
+context;
+
+
+"Arenas"
+
+"An arena hands out memory from large chunks and frees all of it at once."
+"Arena: [0] cursor, [1] end of the current chunk, [2] current chunk, [3] chunk size"
+"Chunk: [0] previous chunk, [1] size, the allocations follow"
+
+context arena_create i64 __chunk -> ptr;
+declare i64* __arena;
+declare i64* __first;
+declare i64 __start;
+declare i64 __end;
+
+if __chunk < 4096;
+  assign __chunk = 65536;
+fi;
+
+alloc(32) -> __arena;
+alloc(__chunk) -> __first;
+array __first 0 = 0;
+array __first 1 = __chunk;
+
+assign __start = __first;
+assign __end = __start + __chunk;
+array __arena 2 = __start;
+assign __start = __start + 16;
+array __arena 0 = __start;
+array __arena 1 = __end;
+array __arena 3 = __chunk;
+
+return __arena;
+context;
+
+context arena_grow i64* __arena i64 __size -> ptr;
+declare i64* __chunk;
+declare i64 __bytes;
+declare i64 __start;
+declare i64 __head;
+
+array __arena 3 -> __bytes;
+assign __start = __size + 16;
+if __bytes < __start;
+  assign __bytes = __start;
+fi;
+
+alloc(__bytes) -> __chunk;
+array __arena 2 -> __head;
+array __chunk 0 = __head;
+array __chunk 1 = __bytes;
+
+assign __start = __chunk;
+array __arena 2 = __start;
+assign __bytes = __start + __bytes;
+array __arena 1 = __bytes;
+assign __start = __start + 16;
+assign __head = __start + __size;
+array __arena 0 = __head;
+
+return __start;
+context;
+
+"Allocations stay 16 byte aligned like malloc's, only a full chunk leaves the fast path"
+
+context arena_alloc i64* __arena i64 __size -> ptr;
+declare i64 __cursor;
+declare i64 __next;
+declare i64 __end;
+
+assign __size = __size + 15;
+assign __size = __size / 16;
+assign __size = __size * 16;
+
+array __arena 0 -> __cursor;
+array __arena 1 -> __end;
+assign __next = __cursor + __size;
+if __next > __end;
+  arena_grow(__arena, __size) -> __cursor;
+  return __cursor;
+fi;
+
+array __arena 0 = __next;
+return __cursor;
+context;
+
+"Frees every chunk but the first one"
+
+context arena_reset i64* __arena -> void;
+declare i64* __chunk;
+declare i64* __previous;
+declare i64 __start;
+declare i64 __end;
+
+array __arena 2 -> __chunk;
+array __chunk 0 -> __previous;
+while __previous != 0;
+  delete(__chunk);
+  assign __chunk = __previous;
+  array __chunk 0 -> __previous;
+done;
+
+array __chunk 1 -> __end;
+assign __start = __chunk;
+assign __end = __start + __end;
+array __arena 2 = __start;
+assign __start = __start + 16;
+array __arena 0 = __start;
+array __arena 1 = __end;
+
+return;
+context;
+
+context arena_destroy i64* __arena -> void;
+declare ptr __chunk;
+
+arena_reset(__arena);
+array __arena 2 -> __chunk;
+delete(__chunk);
+delete(__arena);
+
+return;
+context;
+
+
+
+
+"Parse functions"
+
+context parse_int str buff -> i32;
+declare i32 result;
+declare str end;
+declare str* end_p;
+declare i32 si;
+declare i64 sl;
+declare i8 c;
+
+assign end_p -> end;
+
+strtol(buff, end_p, 10) -> sl;
+
+if end == buff;
+collapse("[parse_int] parse failed");
+fi;
+
+deref end -> c;
+
+if 0 != c;
+collapse("[parse_int] parse failed");
+fi;
+
+return sl;
+
+context;
+
+"Parses a whole string without the strtol round trip, can collapse"
+
+context parse_i64 str __text -> i64;
+declare i64 __index;
+declare i64 __value;
+declare i64 __digit;
+declare i64 __negative;
+declare i64 __min;
+declare i64 __limit;
+declare i8 __c;
+
+assign __min = 0 - 9223372036854775807;
+assign __min = __min - 1;
+assign __index = 0;
+assign __negative = 0;
+array __text 0 -> __c;
+if __c == '-';
+  assign __negative = 1;
+  assign __index = 1;
+fi;
+
+array __text __index -> __c;
+assign __digit = __c - '0';
+if __digit > 9;
+  assign __digit = 0 - 1;
+fi;
+if __digit < 0;
+  collapse("[parse_i64] parse failed");
+fi;
+
+"Digits are accumulated as a negative number, so the smallest i64 fits too"
+assign __value = 0;
+while __digit >= 0;
+  assign __limit = __min + __digit;
+  assign __limit = __limit / 10;
+  if __value < __limit;
+    collapse("[parse_i64] out of range");
+  fi;
+  assign __value = __value * 10 - __digit;
+  assign __index = __index + 1;
+  array __text __index -> __c;
+  assign __digit = __c - '0';
+  if __digit > 9;
+    assign __digit = 0 - 1;
+  fi;
+done;
+
+if __c != 0;
+  collapse("[parse_i64] parse failed");
+fi;
+if __negative == 0;
+  if __value == __min;
+    collapse("[parse_i64] out of range");
+  fi;
+  assign __value = 0 - __value;
+fi;
+
+return __value;
+context;
+
+)";
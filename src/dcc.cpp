@@ -1,21 +1,37 @@
 #include <args.hpp>
+#include <codegen.hpp>
 #include <compiler.hpp>
 #include <fs.hpp>
 #include <lexer.hpp>
+#include <server.hpp>
 #include <stdio.h>
+#include <string.h>
 #include <vector>
 
-#define DCC_VER "nightly"
-
-int main(int argc, char **argv) {
-  Settings settings;
-  ArgParser argparser = ArgParser(argc, argv);
-
+static void setDefaults(Settings &settings, char *argv0) {
   settings.compilation_level = CL_EXE;
   settings.output_name = "a.out";
   settings.libs = "";
   settings.pic = true;
   settings.nostdlib = false;
+  settings.opt_level = OL_O0;
+  settings.build_std = false;
+  settings.build_io = false;
+  settings.std_dir = getExecutableDir(argv0);
+  settings.cache_dir = "";
+  settings.cache_stats = false;
+  settings.time_report = false;
+  settings.time_report_json = false;
+  settings.lto = false;
+  settings.profile_generate = false;
+  settings.profile_use = "";
+  settings.instrument_contexts = false;
+}
+
+static int run(int argc, char **argv) {
+  Settings settings;
+  ArgParser argparser = ArgParser(argc, argv);
+  setDefaults(settings, argv[0]);
 
   while (true) {
     std::string arg = argparser.next();
@@ -32,7 +48,22 @@ int main(int argc, char **argv) {
         printf("  --ir (-i)                Generate only IR code\n");
         printf("  --asm (-S)               Generate only assembly\n");
         printf("  --obj (-c)               Generate only object file\n");
+        printf("  --run (-r)               Compile and run in-process, arguments after -- are passed to the program\n");
         printf("  --nostdlib               Disable standard library\n");
+        printf("  --build-std              Build the precompiled standard library\n");
+        printf("  --build-io               Build the precompiled I/O library\n");
+        printf("  --cache                  Cache objects of unchanged files in ~/.cache/dcc\n");
+        printf("  --cache-dir <dir>        Cache objects of unchanged files in <dir>\n");
+        printf("  --cache-stats            Print cache hit/miss statistics\n");
+        printf("  --time-report            Print time spent in every compiler phase\n");
+        printf("  --time-report=json       Print the time report as JSON\n");
+        printf("  --server <socket>        Serve compilations on a Unix socket from a warm process\n");
+        printf("  --client <socket> ...    Compile the rest of the command line on the server at <socket>\n");
+        printf("  -O<level>                Optimization level (0, 1, 2, 3, s)\n");
+        printf("  -flto                    Emit bitcode objects and optimize the program with the standard library when linking\n");
+        printf("  --profile-generate       Instrument the program to write an execution profile (cc has to be clang)\n");
+        printf("  --profile-use <file>     Optimize with a profile merged by llvm-profdata\n");
+        printf("  --instrument-contexts    Report calls and cycles of every context when the program exits\n");
         printf("  -l <lib>                 Link libraries\n");
         printf("  -v                       Get current version\n");
         printf("  -o                       Set output filename\n");
@@ -43,8 +74,55 @@ int main(int argc, char **argv) {
         settings.compilation_level = CL_ASM;
       } else if (arg == "--obj" || arg == "-c") {
         settings.compilation_level = CL_OBJ;
+      } else if (arg == "--run" || arg == "-r") {
+        settings.compilation_level = CL_RUN;
+      } else if (arg == "--") {
+        while (true) {
+          std::string runArg = argparser.next();
+          if (runArg == "")
+            break;
+          settings.run_args.push_back(runArg);
+        }
+        break;
       } else if (arg == "--nostdlib") {
         settings.nostdlib = true;
+      } else if (arg == "--build-std") {
+        settings.build_std = true;
+        settings.nostdlib = true;
+        settings.compilation_level = CL_OBJ;
+      } else if (arg == "--build-io") {
+        settings.build_io = true;
+        settings.nostdlib = true;
+        settings.compilation_level = CL_OBJ;
+      } else if (arg == "--cache") {
+        settings.cache_dir = getDefaultCacheDir();
+      } else if (arg == "--cache-dir") {
+        settings.cache_dir = argparser.next();
+      } else if (arg == "--cache-stats") {
+        settings.cache_stats = true;
+      } else if (arg == "--time-report") {
+        settings.time_report = true;
+      } else if (arg == "--time-report=json") {
+        settings.time_report = true;
+        settings.time_report_json = true;
+      } else if (arg == "-O0") {
+        settings.opt_level = OL_O0;
+      } else if (arg == "-O1") {
+        settings.opt_level = OL_O1;
+      } else if (arg == "-O2" || arg == "-O") {
+        settings.opt_level = OL_O2;
+      } else if (arg == "-O3") {
+        settings.opt_level = OL_O3;
+      } else if (arg == "-Os") {
+        settings.opt_level = OL_Os;
+      } else if (arg == "-flto") {
+        settings.lto = true;
+      } else if (arg == "--profile-generate") {
+        settings.profile_generate = true;
+      } else if (arg == "--profile-use") {
+        settings.profile_use = argparser.next();
+      } else if (arg == "--instrument-contexts") {
+        settings.instrument_contexts = true;
       } else if (arg == "-l") {
         settings.libs += argparser.next() + " ";
       } else if (arg == "-v") {
@@ -67,107 +145,47 @@ int main(int argc, char **argv) {
   settings.filenames.push_back("/home/aceinet/dcmake/lua.dc");
   settings.filenames.push_back("/home/aceinet/dcmake/dcmake.dc");
 #endif
-  if (settings.filenames.empty()) {
+  if (settings.filenames.empty() && !settings.build_std && !settings.build_io) {
     printf("\x1b[1mdcc:\x1b[0m \x1b[1;31mfatal error:\x1b[0m no input files\n");
     printf("compilation terminated.\n");
     return 1;
   }
 
-  std::string input = "";
-  if (!settings.nostdlib) {
-    input = R"(
-extern i32 printf str vararg;
-extern i32 scanf str vararg;
-extern ptr malloc i64;
-extern void free ptr;
-extern void exit i32;
-extern i64 strtol str str* i32;
-
-
-"Collapses"
-
-context collapse_handler str desc -> void;
-
-printf("Program collapsed: %s\n", desc);
-
-exit(128);
-return;
-context;
-
-context collapse str desc -> void;
-
-collapse_handler(desc);
-
-return;
-context;
-
-
-"Memory Allocations"
-
-context alloc i64 __size -> ptr;
-declare ptr __ptr;
-
-malloc(__size) -> __ptr;
-
-if __ptr == 0;
-  collapse("Failed to allocate memory");
-fi;
-
-return __ptr;
-context;
-
-context delete ptr __ptr -> void;
-
-free(__ptr);
-
-return;
-context;
-
-
-
-
-"Parse functions"
-
-context parse_int str buff -> i32;
-declare i32 result;
-declare str end;
-declare str* end_p;
-declare i32 si;
-declare i64 sl;
-declare i8 c;
-
-assign end_p -> end;
-
-strtol(buff, end_p, 10) -> sl;
-
-if end == buff;
-collapse("[parse_int] parse failed");
-fi;
-
-deref end -> c;
-
-if 0 != c;
-collapse("[parse_int] parse failed");
-fi;
-
-return sl;
+  if (settings.profile_generate && settings.compilation_level == CL_RUN) {
+    printf("\x1b[1mdcc:\x1b[0m \x1b[1;31merror:\x1b[0m --profile-generate needs the profile runtime, it can't be used with --run\n");
+    return 1;
+  }
 
-context;
+  return compile(settings);
+}
 
-)";
-  }
-  int stdlib_newlines = 0;
-  for (int i = 0; i < input.size(); i++) {
-    if (input.at(i) == '\n') {
-      stdlib_newlines++;
+int main(int argc, char **argv) {
+  try {
+    if (argc >= 3 && strcmp(argv[1], "--server") == 0) {
+      // Everything a request would set up first is done once, the forked requests start from here
+      Settings settings;
+      setDefaults(settings, argv[0]);
+      getTargetMachine(settings);
+      try {
+        loadStandardLibrary(settings);
+      } catch (DCError &) {
+      }
+      return runServer(argv[2], run);
     }
-  }
 
-  for (std::string &filename : settings.filenames) {
-    input += "\n" + readFile(filename);
+    if (argc >= 3 && strcmp(argv[1], "--client") == 0) {
+      std::string socketPath = argv[2];
+      argv[2] = argv[0];
+      int exitcode = runClient(socketPath, argc - 2, argv + 2);
+      if (exitcode >= 0)
+        return exitcode;
+      // Without a server the command line is compiled right here
+      return run(argc - 2, argv + 2);
+    }
+  } catch (DCError &err) {
+    printf("%s", err.format().c_str());
+    return 1;
   }
 
-  Lexer lexer(input, stdlib_newlines);
-
-  compile(lexer, settings);
+  return run(argc, argv);
 }
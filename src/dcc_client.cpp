@@ -0,0 +1,32 @@
+#include <error.hpp>
+#include <server.hpp>
+#include <stdio.h>
+#include <string>
+#include <unistd.h>
+
+// Thin client of `dcc --server`, it stays clear of LLVM so a request costs no more than starting a tiny process
+int main(int argc, char **argv) {
+  if (argc < 2 || std::string(argv[1]) == "--help") {
+    printf("Usage: dcc-client <socket> [dcc options]\n");
+    return argc < 2;
+  }
+
+  std::string socketPath = argv[1];
+  argv[1] = argv[0];
+  try {
+    int exitcode = runClient(socketPath, argc - 1, argv + 1);
+    if (exitcode >= 0)
+      return exitcode;
+  } catch (DCError &err) {
+    printf("%s", err.format().c_str());
+    return 1;
+  }
+
+  // Without a server the dcc next to the client compiles the command line itself
+  std::string self = argv[0];
+  std::string dcc = self.find('/') == std::string::npos ? "dcc" : self.substr(0, self.rfind('/') + 1) + "dcc";
+  argv[1] = (char *)dcc.c_str();
+  execvp(dcc.c_str(), argv + 1);
+  printf("\x1b[1mdcc:\x1b[0m \x1b[1;31mfatal error:\x1b[0m no server at %s and failed to run %s\n", socketPath.c_str(), dcc.c_str());
+  return 1;
+}
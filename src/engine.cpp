@@ -0,0 +1,181 @@
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+
+#include <codegen.hpp>
+#include <compiler.hpp>
+#include <dc.hpp>
+#include <jit.hpp>
+#include <lexer.hpp>
+
+using namespace llvm;
+
+// Digits are dropped from the module id in mangled names, the counter is spelled in letters
+static std::string getDefaultName(size_t index)
+{
+  std::string name = "script";
+  do
+  {
+    name += 'a' + index % 26;
+    index /= 26;
+  } while (index > 0);
+  return name;
+}
+
+DCEngine::DCEngine(OptLevel optLevel, const std::string &stdDir)
+{
+  settings.output_name = "script";
+  settings.libs = "";
+  settings.nostdlib = stdDir.empty();
+  settings.build_std = false;
+  settings.build_io = false;
+  settings.std_dir = stdDir;
+  settings.cache_dir = "";
+  settings.cache_stats = false;
+  settings.time_report = false;
+  settings.time_report_json = false;
+  settings.lto = false;
+  settings.profile_generate = false;
+  settings.profile_use = "";
+  settings.instrument_contexts = false;
+  settings.compilation_level = CL_RUN;
+  settings.opt_level = optLevel;
+  settings.pic = true;
+}
+
+DCEngine::~DCEngine()
+{
+  if (jit != nullptr)
+  {
+    consumeError(jit->deinitialize(jit->getMainJITDylib()));
+  }
+}
+
+void DCEngine::defineExtern(const std::string &name, const std::string &signature, void *address)
+{
+  symbols.push_back(name + " " + signature);
+  hostSymbols.push_back({name, address});
+
+  lastError.reset();
+  if (jit != nullptr)
+  {
+    try
+    {
+      defineHostSymbol(name, address);
+    }
+    catch (DCError &err)
+    {
+      lastError = err;
+    }
+  }
+}
+
+bool DCEngine::load(const std::string &source, const std::string &name)
+{
+  lastError.reset();
+  try
+  {
+    if (jit == nullptr)
+    {
+      jit = createJIT(settings);
+      std::vector<std::string> stdSymbols = loadStandardLibrary(settings);
+      symbols.insert(symbols.begin(), stdSymbols.begin(), stdSymbols.end());
+      for (auto &[hostName, address] : hostSymbols)
+      {
+        defineHostSymbol(hostName, address);
+      }
+    }
+
+    // The module identifier is part of every mangled name, so sources loaded under different names never clash
+    std::string moduleName = name.empty() ? getDefaultName(unnamedLoads++) : name;
+    settings.output_name = moduleName;
+    settings.filenames = {moduleName};
+    Lexer lexer(source);
+    DCFile file = parseFile(lexer);
+    DCModule module = compileModule(file, settings, symbols, 0, file.contexts.size());
+    optimizeModule(*module.module, settings);
+
+    // Only recorded once the module is in the JIT, a failed load leaves nothing lookup could find
+    std::vector<std::string> loaded = getModuleSymbols(*module.module);
+    std::vector<std::pair<std::string, std::string>> loadedContexts;
+    for (Function &fn : *module.module)
+    {
+      if (!fn.isDeclaration() && !fn.hasLocalLinkage())
+      {
+        loadedContexts.push_back({getContextKey(fn.getName()), fn.getName().str()});
+      }
+    }
+
+    module.module->setDataLayout(jit->getDataLayout());
+    if (Error err = jit->addIRModule(orc::ThreadSafeModule(std::move(module.module), orc::ThreadSafeContext(std::move(module.context)))))
+    {
+      fatalError(toString(std::move(err)));
+    }
+    if (Error err = jit->initialize(jit->getMainJITDylib()))
+    {
+      fatalError(toString(std::move(err)));
+    }
+    symbols.insert(symbols.end(), loaded.begin(), loaded.end());
+    contexts.insert(contexts.end(), loadedContexts.begin(), loadedContexts.end());
+    return true;
+  }
+  catch (DCError &err)
+  {
+    lastError = err;
+    return false;
+  }
+}
+
+void *DCEngine::lookup(const std::string &context)
+{
+  lastError.reset();
+  if (jit == nullptr)
+  {
+    lastError = DCError(EK_FATAL, "nothing was loaded");
+    return nullptr;
+  }
+
+  // A link name is taken as it is, anything else is looked up like a call in dc source
+  std::string linkName = "";
+  std::string key = getContextKey(context);
+  for (auto &[contextKey, contextLink] : contexts)
+  {
+    if (contextLink == context)
+    {
+      linkName = contextLink;
+      break;
+    }
+    if (linkName.empty() && contextKey == key)
+    {
+      linkName = contextLink;
+    }
+  }
+
+  if (linkName.empty())
+  {
+    lastError = DCError(EK_FATAL, "no context named " + context);
+    return nullptr;
+  }
+
+  Expected<orc::ExecutorAddr> address = jit->lookup(linkName);
+  if (!address)
+  {
+    lastError = DCError(EK_FATAL, toString(address.takeError()));
+    return nullptr;
+  }
+  return address->toPtr<void *>();
+}
+
+const std::optional<DCError> &DCEngine::error() const
+{
+  return lastError;
+}
+
+void DCEngine::defineHostSymbol(const std::string &name, void *address)
+{
+  orc::SymbolMap symbol;
+  symbol[jit->mangleAndIntern(name)] = {orc::ExecutorAddr::fromPtr(address), JITSymbolFlags::Exported | JITSymbolFlags::Callable};
+  if (Error err = jit->getMainJITDylib().define(orc::absoluteSymbols(std::move(symbol))))
+  {
+    fatalError(toString(std::move(err)));
+  }
+}
@@ -0,0 +1,17 @@
+#include <error.hpp>
+
+DCError::DCError(DCErrorKind kind, const std::string &message, int line) : std::runtime_error(message), kind(kind), line(line) {}
+
+std::string DCError::format() const
+{
+  if (kind == EK_COMPILATION)
+  {
+    return "\x1b[1mdcc:\x1b[0m \x1b[1;31mcompilation error:\n ~" + std::to_string(line) + " | \x1b[0m " + what() + "\n";
+  }
+  return std::string("\x1b[1mdcc:\x1b[0m \x1b[1;31mfatal error:\x1b[0m ") + what() + "\n";
+}
+
+void fatalError(const std::string &message)
+{
+  throw DCError(EK_FATAL, message);
+}
@@ -1,19 +1,40 @@
-#include <fstream>
+#include <error.hpp>
 #include <string>
-#include <iostream>
-#include <sstream>
 
-std::string readFile(const std::string &filename)
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+
+std::unique_ptr<llvm::MemoryBuffer> readFile(const std::string &filename)
 {
-  std::ifstream file(filename);
-  if (!file)
+  // Large files are mapped rather than read, the lexer tokens point straight into the buffer
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer = llvm::MemoryBuffer::getFile(filename, false, false);
+  if (!buffer)
   {
-    std::cerr << "Error opening file: " << filename << "\n";
-    exit(1);
+    fatalError("failed to open " + filename + ": " + buffer.getError().message());
   }
 
-  std::stringstream buffer;
-  buffer << file.rdbuf();
+  return std::move(*buffer);
+}
+
+std::string getExecutablePath(const char *argv0)
+{
+  return llvm::sys::fs::getMainExecutable(argv0, (void *)&getExecutablePath);
+}
 
-  return buffer.str();
+std::string getExecutableDir(const char *argv0)
+{
+  return llvm::sys::path::parent_path(getExecutablePath(argv0)).str();
+}
+
+std::string getDefaultCacheDir()
+{
+  llvm::SmallString<128> dir;
+  if (!llvm::sys::path::cache_directory(dir))
+  {
+    return "";
+  }
+  llvm::sys::path::append(dir, "dcc");
+  return dir.str().str();
 }
@@ -0,0 +1,113 @@
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <codegen.hpp>
+#include <compiler.hpp>
+#include <dc_io.hpp>
+#include <dc_std.hpp>
+#include <error.hpp>
+#include <jit.hpp>
+#include <timing.hpp>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+[[noreturn]] static void jitError(Error err)
+{
+  fatalError(toString(std::move(err)));
+}
+
+std::unique_ptr<orc::LLJIT> createJIT(Settings &settings)
+{
+  initializeNativeTarget();
+  Expected<std::unique_ptr<orc::LLJIT>> jitOrErr = orc::LLJITBuilder().create();
+  if (!jitOrErr)
+  {
+    jitError(jitOrErr.takeError());
+  }
+  std::unique_ptr<orc::LLJIT> jit = std::move(*jitOrErr);
+
+  // Externs (printf, malloc, ...) are resolved from the dcc process itself
+  orc::JITDylib &mainDylib = jit->getMainJITDylib();
+  auto generator = orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(jit->getDataLayout().getGlobalPrefix());
+  if (!generator)
+  {
+    jitError(generator.takeError());
+  }
+  mainDylib.addGenerator(std::move(*generator));
+
+  if (!settings.nostdlib)
+  {
+    std::string stdObject = settings.std_dir + "/" DC_STD_NAME ".o";
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(stdObject);
+    if (!buffer)
+    {
+      fatalError("failed to open " + stdObject + ": " + buffer.getError().message());
+    }
+
+    if (Error err = jit->addObjectFile(std::move(*buffer)))
+    {
+      jitError(std::move(err));
+    }
+  }
+
+  // Like the linker, the JIT only loads the I/O library when the program uses it
+  if (linksIOLibrary(settings))
+  {
+    auto ioLibrary = orc::StaticLibraryDefinitionGenerator::Load(jit->getObjLinkingLayer(), (settings.std_dir + "/" DC_IO_NAME ".a").c_str());
+    if (!ioLibrary)
+    {
+      jitError(ioLibrary.takeError());
+    }
+    mainDylib.addGenerator(std::move(*ioLibrary));
+  }
+  return jit;
+}
+
+int runModule(std::unique_ptr<Module> module, std::unique_ptr<LLVMContext> context, Settings &settings)
+{
+  std::unique_ptr<orc::LLJIT> jit = createJIT(settings);
+  orc::JITDylib &mainDylib = jit->getMainJITDylib();
+
+  module->setDataLayout(jit->getDataLayout());
+  if (Error err = jit->addIRModule(orc::ThreadSafeModule(std::move(module), orc::ThreadSafeContext(std::move(context)))))
+  {
+    jitError(std::move(err));
+  }
+
+  // Looking up main materializes the module, that is where the JIT compiles it
+  std::optional<TimeRegion> jitTime("jit");
+  Expected<orc::ExecutorAddr> mainAddr = jit->lookup("main");
+  if (!mainAddr)
+  {
+    jitError(mainAddr.takeError());
+  }
+
+  if (Error err = jit->initialize(mainDylib))
+  {
+    jitError(std::move(err));
+  }
+  jitTime.reset();
+
+  std::vector<char *> argv;
+  argv.push_back(settings.filenames.front().data());
+  for (std::string &arg : settings.run_args)
+  {
+    argv.push_back(arg.data());
+  }
+  argv.push_back(nullptr);
+
+  int (*mainFn)(int, char **) = mainAddr->toPtr<int (*)(int, char **)>();
+  int exitcode = mainFn(argv.size() - 1, argv.data());
+
+  if (Error err = jit->deinitialize(mainDylib))
+  {
+    jitError(std::move(err));
+  }
+  return exitcode;
+}
@@ -1,208 +1,447 @@
 #include <lexer.hpp>
-#include <iostream>
+#include <array>
+#include <cstring>
 #include <string>
 #include <vector>
-#include <cctype>
 #include <algorithm>
-#include <unordered_map>
 
-Lexer::Lexer(const std::string &src, int startingLine) : source(src), current(0), iterIndex(0), tokens({}), line(0)
+#if defined(__SSE2__) && !defined(DC_LEXER_SCALAR)
+#include <immintrin.h>
+#define DC_LEXER_SIMD
+#endif
+
+typedef enum
 {
-  iterIndex--;
-  line -= startingLine;
-  tokenize();
-}
+  CC_SPACE = 1 << 0,
+  CC_IDENT_START = 1 << 1,
+  CC_IDENT = 1 << 2, // anything an identifier or a type can continue with
+  CC_DIGIT = 1 << 3,
+} DCCharClass;
 
-void Lexer::tokenize()
+static constexpr std::array<uint8_t, 256> charClasses = []()
 {
-  tokens.clear();
-  while (current < source.size())
+  std::array<uint8_t, 256> classes = {};
+  for (int c = 0; c < 256; c++)
   {
-    char c = source[current];
-
-    if (isspace(c) && c != '\n')
+    bool alpha = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    bool digit = c >= '0' && c <= '9';
+    if (c == ' ' || (c >= '\t' && c <= '\r'))
     {
-      current++;
+      classes[c] |= CC_SPACE;
     }
-    else if (c == '*')
+    if (alpha || c == '_' || c == '#')
     {
-      tokens.push_back(Token(TokenType::OPERATOR, "*", 0, line));
-      current++;
+      classes[c] |= CC_IDENT_START;
     }
-    else if (isalpha(c) || c == '_' || c == '*' || c == '#')
+    if (alpha || digit || c == '_' || c == '*' || c == '#')
     {
-      tokens.push_back(identifier());
+      classes[c] |= CC_IDENT;
     }
-    else if (isdigit(c))
+    if (digit)
     {
-      tokens.push_back(number());
+      classes[c] |= CC_DIGIT;
     }
-    else if (c == '\'')
-    {
-      tokens.push_back(character());
-    }
-    else if (c == '"')
-    {
-      tokens.push_back(stringLiteral());
-    }
-    else if (c == ';')
-    {
-      tokens.push_back(Token(TokenType::SEMICOLON, ";", 0, line));
-      current++;
-    }
-    else if (c == '-')
-    {
-      if (current + 1 < source.size() && source[current + 1] == '>')
-      {
-        tokens.push_back(Token(TokenType::ARROW, "->", 0, line));
-        current += 2;
-      }
-      else
-      {
-        tokens.push_back(Token(TokenType::OPERATOR, "-", 0, line));
-        current++;
-      }
-    }
-    else if (c == '+')
+  }
+  return classes;
+}();
+
+static inline bool hasClass(char c, uint8_t cls)
+{
+  return charClasses[(unsigned char)c] & cls;
+}
+
+#if defined(DC_LEXER_SIMD)
+
+#if defined(__AVX2__)
+typedef __m256i Lanes;
+static const size_t LANES = 32;
+#define lanesLoad(p) _mm256_loadu_si256((const __m256i *)(p))
+#define lanesSet(c) _mm256_set1_epi8(c)
+#define lanesEq(a, b) _mm256_cmpeq_epi8(a, b)
+#define lanesGt(a, b) _mm256_cmpgt_epi8(a, b)
+#define lanesOr(a, b) _mm256_or_si256(a, b)
+#define lanesAdd(a, b) _mm256_add_epi8(a, b)
+#define lanesMask(a) (uint32_t) _mm256_movemask_epi8(a)
+#else
+typedef __m128i Lanes;
+static const size_t LANES = 16;
+#define lanesLoad(p) _mm_loadu_si128((const __m128i *)(p))
+#define lanesSet(c) _mm_set1_epi8(c)
+#define lanesEq(a, b) _mm_cmpeq_epi8(a, b)
+#define lanesGt(a, b) _mm_cmpgt_epi8(a, b)
+#define lanesOr(a, b) _mm_or_si128(a, b)
+#define lanesAdd(a, b) _mm_add_epi8(a, b)
+#define lanesMask(a) (uint32_t) _mm_movemask_epi8(a)
+#endif
+
+// Lanes holding a character in [lo, hi], the bytes are shifted so a single signed compare checks both ends
+static inline Lanes lanesInRange(Lanes chars, char lo, char hi)
+{
+  Lanes shifted = lanesAdd(chars, lanesSet((char)(0x80 - lo)));
+  return lanesGt(lanesSet((char)(0x80 + (hi - lo) + 1)), shifted);
+}
+
+static inline uint32_t spaceMask(Lanes chars)
+{
+  return lanesMask(lanesOr(lanesEq(chars, lanesSet(' ')), lanesInRange(chars, '\t', '\r')));
+}
+
+static inline uint32_t identMask(Lanes chars)
+{
+  Lanes lower = lanesOr(chars, lanesSet(0x20));
+  Lanes res = lanesOr(lanesInRange(lower, 'a', 'z'), lanesInRange(chars, '0', '9'));
+  res = lanesOr(res, lanesOr(lanesEq(chars, lanesSet('_')), lanesEq(chars, lanesSet('*'))));
+  return lanesMask(lanesOr(res, lanesEq(chars, lanesSet('#'))));
+}
+
+static inline uint32_t lowBits(size_t count)
+{
+  return count >= 32 ? 0xffffffffu : (1u << count) - 1;
+}
+
+#endif
+
+// Length of the whitespace run at data, the newlines in it are added to lines
+static size_t skipSpaces(const char *data, size_t size, int &lines)
+{
+  size_t i = 0;
+#if defined(DC_LEXER_SIMD)
+  for (; i + LANES <= size; i += LANES)
+  {
+    Lanes chars = lanesLoad(data + i);
+    uint32_t run = ~spaceMask(chars) & lowBits(LANES);
+    uint32_t newlines = lanesMask(lanesEq(chars, lanesSet('\n')));
+    if (run != 0)
     {
-      tokens.push_back(Token(TokenType::OPERATOR, "+", 0, line));
-      current++;
+      size_t length = __builtin_ctz(run);
+      lines += __builtin_popcount(newlines & lowBits(length));
+      return i + length;
     }
-    else if (c == '/')
+    lines += __builtin_popcount(newlines);
+  }
+#endif
+  for (; i < size && hasClass(data[i], CC_SPACE); i++)
+  {
+    lines += data[i] == '\n';
+  }
+  return i;
+}
+
+// Length of the identifier characters run at data
+static size_t scanIdentifier(const char *data, size_t size)
+{
+  size_t i = 0;
+#if defined(DC_LEXER_SIMD)
+  for (; i + LANES <= size; i += LANES)
+  {
+    uint32_t run = ~identMask(lanesLoad(data + i)) & lowBits(LANES);
+    if (run != 0)
     {
-      tokens.push_back(Token(TokenType::OPERATOR, "/", 0, line));
-      current++;
+      return i + __builtin_ctz(run);
     }
-    else if (c == '=')
+  }
+#endif
+  for (; i < size && hasClass(data[i], CC_IDENT); i++)
+  {
+  }
+  return i;
+}
+
+/*
+  Keywords and types are recognized through a perfect hash of their length and first and last character,
+  the table is built at compile time and fails to compile if two words ever share a slot
+*/
+typedef struct
+{
+  std::string_view word;
+  TokenType type;
+} DCReservedWord;
+
+static const size_t RESERVED_SLOTS = 32;
+
+static constexpr size_t reservedHash(std::string_view word)
+{
+  return (word.size() * 9 + (unsigned char)word.front() + (unsigned char)word.back() * 10) & (RESERVED_SLOTS - 1);
+}
+
+static constexpr std::array<DCReservedWord, RESERVED_SLOTS> reservedWords = []()
+{
+  constexpr DCReservedWord words[] = {
+      {"extern", TokenType::KEYWORD},
+      {"context", TokenType::KEYWORD},
+      {"declare", TokenType::KEYWORD},
+      {"assign", TokenType::KEYWORD},
+      {"deref", TokenType::KEYWORD},
+      {"if", TokenType::KEYWORD},
+      {"fi", TokenType::KEYWORD},
+      {"else", TokenType::KEYWORD},
+      {"elif", TokenType::KEYWORD},
+      {"array", TokenType::KEYWORD},
+      {"return", TokenType::KEYWORD},
+      {"while", TokenType::KEYWORD},
+      {"done", TokenType::KEYWORD},
+      {"i64", TokenType::TYPE},
+      {"i32", TokenType::TYPE},
+      {"i16", TokenType::TYPE},
+      {"i8", TokenType::TYPE},
+      {"str", TokenType::TYPE},
+      {"ptr", TokenType::TYPE}};
+
+  std::array<DCReservedWord, RESERVED_SLOTS> table = {};
+  for (const DCReservedWord &word : words)
+  {
+    DCReservedWord &slot = table[reservedHash(word.word)];
+    if (!slot.word.empty())
     {
-      if (current + 1 < source.size() && source[current + 1] == '=')
-      {
-        tokens.push_back(Token(TokenType::OPERATOR, "==", 0, line));
-        current += 2;
-      }
-      else
-      {
-        tokens.push_back(Token(TokenType::OPERATOR, "=", 0, line));
-        current++;
-      }
+      throw "keyword hash collision";
     }
-    else if (c == '<')
+    slot = word;
+  }
+  return table;
+}();
+
+// Every lexer interns the reserved words first, so their symbols are known without hashing them again
+static constexpr std::array<uint32_t, RESERVED_SLOTS> reservedSymbols = []()
+{
+  std::array<uint32_t, RESERVED_SLOTS> symbols = {};
+  uint32_t next = 1;
+  for (size_t i = 0; i < RESERVED_SLOTS; i++)
+  {
+    if (!reservedWords[i].word.empty())
     {
-      if (current + 1 < source.size() && source[current + 1] == '=')
-      {
-        tokens.push_back(Token(TokenType::OPERATOR, "<=", 0, line));
-        current += 2;
-      }
-      else
-      {
-        tokens.push_back(Token(TokenType::OPERATOR, "<", 0, line));
-        current++;
-      }
+      symbols[i] = next++;
     }
-    else if (c == '>')
+  }
+  return symbols;
+}();
+
+// The slot of a reserved word, nullptr for anything that is not reserved
+static const DCReservedWord *findReserved(std::string_view value)
+{
+  if (value.empty())
+  {
+    return nullptr;
+  }
+  const DCReservedWord &slot = reservedWords[reservedHash(value)];
+  return slot.word == value ? &slot : nullptr;
+}
+
+static uint32_t hashName(std::string_view name)
+{
+  // FNV-1a, names are short
+  uint32_t hash = 2166136261u;
+  for (char c : name)
+  {
+    hash = (hash ^ (unsigned char)c) * 16777619u;
+  }
+  return hash;
+}
+
+uint32_t Interner::intern(std::string_view name)
+{
+  uint32_t hash = hashName(name);
+  size_t mask = slots.size() - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask)
+  {
+    uint32_t symbol = slots[i];
+    if (symbol == 0)
     {
-      if (current + 1 < source.size() && source[current + 1] == '=')
+      symbol = names.size();
+      slots[i] = symbol;
+      names.push_back(name);
+      hashes.push_back(hash);
+      if (names.size() * 2 > slots.size())
       {
-        tokens.push_back(Token(TokenType::OPERATOR, ">=", 0, line));
-        current += 2;
-      }
-      else
-      {
-        tokens.push_back(Token(TokenType::OPERATOR, ">", 0, line));
-        current++;
+        grow();
       }
+      return symbol;
     }
-    else if (c == '!')
+    if (hashes[symbol] == hash && names[symbol] == name)
     {
-      if (current + 1 < source.size() && source[current + 1] == '=')
-      {
-        tokens.push_back(Token(TokenType::OPERATOR, "!=", 0, line));
-        current += 2;
-      }
+      return symbol;
     }
-    else if (c == '(')
+  }
+}
+
+void Interner::grow()
+{
+  std::vector<uint32_t> old(slots.size() * 2, 0);
+  old.swap(slots);
+  size_t mask = slots.size() - 1;
+  for (uint32_t symbol = 1; symbol < names.size(); symbol++)
+  {
+    size_t i = hashes[symbol] & mask;
+    while (slots[i] != 0)
     {
-      tokens.push_back(Token(TokenType::LPAREN, "(", 0, line));
-      current++;
+      i = (i + 1) & mask;
     }
-    else if (c == ')')
+    slots[i] = symbol;
+  }
+}
+
+std::string_view Interner::name(uint32_t symbol)
+{
+  return names.at(symbol);
+}
+
+Lexer::Lexer(std::string_view src, int startingLine) : source(src), current(0), line(1), window(WINDOW, Token(TokenType::END, "")), produced(0), position(0), end(TokenType::END, "")
+{
+  line -= startingLine;
+  for (const DCReservedWord &reserved : reservedWords)
+  {
+    if (!reserved.word.empty())
     {
-      tokens.push_back(Token(TokenType::RPAREN, ")", 0, line));
-      current++;
+      symbols.intern(reserved.word);
     }
-    else if (c == ',')
+  }
+}
+
+const char *Lexer::scanner()
+{
+#if defined(DC_LEXER_SIMD) && defined(__AVX2__)
+  return "avx2";
+#elif defined(DC_LEXER_SIMD)
+  return "sse2";
+#else
+  return "scalar";
+#endif
+}
+
+const Token &Lexer::next()
+{
+  if (position == produced)
+  {
+    window[produced % WINDOW] = scan();
+    produced++;
+  }
+  return window[position++ % WINDOW];
+}
+
+// The token next() returned most recently
+const Token &Lexer::last()
+{
+  if (position == 0)
+  {
+    return end;
+  }
+  return window[(position - 1) % WINDOW];
+}
+
+// Steps back so the next count tokens are handed out again, fails if they already left the window
+bool Lexer::rewind(size_t count)
+{
+  if (count > position || produced - (position - count) > WINDOW)
+  {
+    return false;
+  }
+  position -= count;
+  return true;
+}
+
+size_t Lexer::count()
+{
+  return produced;
+}
+
+Token Lexer::symbol(TokenType type, size_t length)
+{
+  Token token(type, source.substr(current, length), 0, line);
+  current += length;
+  return token;
+}
+
+Token Lexer::scan()
+{
+  while (current < source.size())
+  {
+    char c = source[current];
+    char n = current + 1 < source.size() ? source[current + 1] : '\0';
+
+    uint8_t cls = charClasses[(unsigned char)c];
+    if (cls & CC_SPACE)
     {
-      tokens.push_back(Token(TokenType::COMMA, ",", 0, line));
-      current++;
+      current += skipSpaces(source.data() + current, source.size() - current, line);
+      continue;
     }
-    else if (c == '%')
+    if (cls & CC_IDENT_START)
     {
-      tokens.push_back(Token(TokenType::OPERATOR, "%", 0, line));
-      current++;
+      return identifier();
     }
-    else if (c == '\n')
+    if (cls & CC_DIGIT)
     {
-      line++;
-      current++;
+      return number();
     }
-    else
+
+    switch (c)
     {
-      tokens.push_back(Token(TokenType::UNKNOWN, std::string(1, c), 0, line));
-      current++;
+    case '*':
+    case '+':
+    case '/':
+    case '%':
+      return symbol(TokenType::OPERATOR, 1);
+    case '\'':
+      return character();
+    case '"':
+      return stringLiteral();
+    case ';':
+      return symbol(TokenType::SEMICOLON, 1);
+    case '-':
+      return n == '>' ? symbol(TokenType::ARROW, 2) : symbol(TokenType::OPERATOR, 1);
+    case '=':
+    case '<':
+    case '>':
+      return symbol(TokenType::OPERATOR, n == '=' ? 2 : 1);
+    case '!':
+      return n == '=' ? symbol(TokenType::OPERATOR, 2) : symbol(TokenType::UNKNOWN, 1);
+    case '(':
+      return symbol(TokenType::LPAREN, 1);
+    case ')':
+      return symbol(TokenType::RPAREN, 1);
+    case ',':
+      return symbol(TokenType::COMMA, 1);
+    default:
+      return symbol(TokenType::UNKNOWN, 1);
     }
   }
-  tokens.push_back(Token(TokenType::END, "", 0, line));
-}
-
-Token Lexer::next()
-{
-  iterIndex++;
-  try
-  {
-    return tokens.at(iterIndex);
-  }
-  catch (std::out_of_range)
-  {
-    return Token(TokenType::END, "", 0, line);
-  }
+  end.line = line;
+  return end;
 }
 
 Token Lexer::identifier()
 {
   size_t start = current;
-  while (current < source.size() && (isalnum(source[current]) || source[current] == '_' || source[current] == '*' || source[current] == '#'))
-  {
-    current++;
-  }
-  std::string value = source.substr(start, current - start);
-  if (isKeyword(value))
+  current += scanIdentifier(source.data() + current, source.size() - current);
+  std::string_view value = source.substr(start, current - start);
+
+  // Pointer stars trail the base type name
+  std::string_view base = value.substr(0, value.find('*'));
+  const DCReservedWord *reserved = findReserved(base);
+  if (reserved != nullptr && base.size() == value.size())
   {
-    return Token(TokenType::KEYWORD, value);
+    return Token(reserved->type, value, 0, line, reservedSymbols[reserved - reservedWords.data()]);
   }
-  else if (isType(value))
+  else if (reserved != nullptr && reserved->type == TokenType::TYPE && value.find_first_not_of('*', base.size()) == std::string_view::npos)
   {
-    return Token(TokenType::TYPE, value, std::count(value.begin(), value.end(), '*'), line);
+    return Token(TokenType::TYPE, value, value.size() - base.size(), line, symbols.intern(value));
   }
-  return Token(TokenType::IDENTIFIER, value, 0, line);
+  return Token(TokenType::IDENTIFIER, value, 0, line, symbols.intern(value));
 }
 
 Token Lexer::number()
 {
   size_t start = current;
-  while (current < source.size() && isdigit(source[current]))
+  while (current < source.size() && hasClass(source[current], CC_DIGIT))
   {
     current++;
   }
-  return Token(TokenType::LITERAL, source.substr(start, current - start));
+  return Token(TokenType::LITERAL, source.substr(start, current - start), 0, line);
 }
 
 Token Lexer::character()
 {
   size_t start = current++;
-  while (current < source.size() && source[current] != '\'')
-  {
-    current++;
-  }
+  const void *quote = memchr(source.data() + current, '\'', source.size() - current);
+  current = quote == nullptr ? source.size() : (const char *)quote - source.data();
   current++; // Skip the closing quote
   return Token(TokenType::LITERAL, source.substr(start, current - start), 0, line);
 }
@@ -210,48 +449,8 @@ Token Lexer::character()
 Token Lexer::stringLiteral()
 {
   size_t start = current++;
-  while (current < source.size() && source[current] != '"')
-  {
-    current++;
-  }
+  const void *quote = memchr(source.data() + current, '"', source.size() - current);
+  current = quote == nullptr ? source.size() : (const char *)quote - source.data();
   current++; // Skip the closing quote
   return Token(TokenType::STRING_LITERAL, source.substr(start, current - start), 0, line);
 }
-
-bool Lexer::isKeyword(const std::string &value)
-{
-  static const std::unordered_map<std::string, TokenType> keywords = {
-      {"extern", TokenType::KEYWORD},
-      {"context", TokenType::KEYWORD},
-      {"declare", TokenType::KEYWORD},
-      {"assign", TokenType::KEYWORD},
-      {"deref", TokenType::KEYWORD},
-      {"if", TokenType::KEYWORD},
-      {"fi", TokenType::KEYWORD},
-      {"else", TokenType::KEYWORD},
-      {"elif", TokenType::KEYWORD},
-      {"array", TokenType::KEYWORD},
-      {"return", TokenType::KEYWORD}};
-  return keywords.find(value) != keywords.end();
-}
-
-bool Lexer::isType(std::string &value)
-{
-  std::string v = value;
-  try
-  {
-    v.erase(std::remove(v.begin(), v.end(), '*'), v.end());
-  }
-  catch (std::length_error &e)
-  {
-    // do nothing
-  }
-  static const std::unordered_map<std::string, TokenType> types = {
-      {"i64", TokenType::TYPE},
-      {"i32", TokenType::TYPE},
-      {"i16", TokenType::TYPE},
-      {"i8", TokenType::TYPE},
-      {"str", TokenType::TYPE},
-      {"ptr", TokenType::TYPE}};
-  return types.find(v) != types.end();
-}
@@ -0,0 +1,68 @@
+#include <parallel.hpp>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+unsigned getWorkerCount(size_t jobs)
+{
+  unsigned cores = std::thread::hardware_concurrency();
+  if (cores == 0)
+  {
+    cores = 1;
+  }
+  return jobs < cores ? jobs : cores;
+}
+
+void parallelFor(size_t jobs, const std::function<void(size_t)> &fn)
+{
+  unsigned workers = getWorkerCount(jobs);
+  if (workers <= 1)
+  {
+    for (size_t i = 0; i < jobs; i++)
+    {
+      fn(i);
+    }
+    return;
+  }
+
+  // Workers pull the next job index until every job has been taken
+  std::atomic<size_t> next = 0;
+  std::exception_ptr failure;
+  std::mutex failureMutex;
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < workers; i++)
+  {
+    threads.emplace_back([&]()
+                         {
+                           size_t job;
+                           while ((job = next++) < jobs)
+                           {
+                             try
+                             {
+                               fn(job);
+                             }
+                             catch (...)
+                             {
+                               // The first failure wins, the remaining jobs are dropped
+                               std::lock_guard<std::mutex> lock(failureMutex);
+                               if (failure == nullptr)
+                               {
+                                 failure = std::current_exception();
+                               }
+                               next = jobs;
+                             }
+                           } });
+  }
+
+  for (std::thread &thread : threads)
+  {
+    thread.join();
+  }
+
+  if (failure != nullptr)
+  {
+    std::rethrow_exception(failure);
+  }
+}
@@ -0,0 +1,591 @@
+#include <ast.hpp>
+#include <compiler.hpp>
+#include <charconv>
+#include <climits>
+
+class Parser
+{
+public:
+  Parser(Lexer &lexer) : lexer(lexer) {}
+
+  DCFile parse();
+
+private:
+  Lexer &lexer;
+
+  const Token &next();
+  const Token &peek();
+  const Token &expect(TokenType type, const std::string &err);
+  void skipStatement();
+
+  DCExtern parseExtern(const Token &keyword);
+  DCContext parseContext(const Token &keyword);
+  Token parseBlock(std::vector<DCStmt> &body);
+  void parseStatement(const Token &token, std::vector<DCStmt> &body);
+  void parseIf(DCStmt &stmt);
+  void pruneIf(DCStmt &stmt);
+  void parseWhile(DCStmt &stmt);
+
+  std::unique_ptr<DCExpr> parseCondition();
+  std::unique_ptr<DCExpr> parseExpression();
+  std::unique_ptr<DCExpr> parseTerm();
+  std::unique_ptr<DCExpr> parseFactor();
+};
+
+static std::unique_ptr<DCExpr> makeExpr(DCExprKind kind, const Token &token, std::unique_ptr<DCExpr> lhs = nullptr, std::unique_ptr<DCExpr> rhs = nullptr)
+{
+  std::unique_ptr<DCExpr> expr = std::make_unique<DCExpr>();
+  expr->kind = kind;
+  expr->token = token;
+  expr->lhs = std::move(lhs);
+  expr->rhs = std::move(rhs);
+  return expr;
+}
+
+static int64_t parseNumber(const Token &token)
+{
+  int64_t res = 0;
+  std::string_view str = token.value;
+  std::from_chars_result parsed = std::from_chars(str.data(), str.data() + str.size(), res);
+  if (parsed.ec == std::errc::result_out_of_range)
+  {
+    compilationError("Integer literal out of range", token.line);
+  }
+  if (parsed.ec != std::errc() || parsed.ptr != str.data() + str.size())
+  {
+    compilationError("Invalid integer literal " + std::string(str), token.line);
+  }
+  return res;
+}
+
+static bool fitsIn(int64_t value, int64_t min, int64_t max)
+{
+  return value >= min && value <= max;
+}
+
+/*
+  Literals are folded as 64 bit integers, the type they end up in is only known while lowering.
+  +, - and * wrap the same way in every width, / and % are only folded when nothing could have wrapped in i8
+*/
+static bool foldBinary(char op, int64_t lhs, int64_t rhs, int64_t &res)
+{
+  switch (op)
+  {
+  case '+':
+    res = (int64_t)((uint64_t)lhs + (uint64_t)rhs);
+    return true;
+  case '-':
+    res = (int64_t)((uint64_t)lhs - (uint64_t)rhs);
+    return true;
+  case '*':
+    res = (int64_t)((uint64_t)lhs * (uint64_t)rhs);
+    return true;
+  case '/':
+  case '%':
+    if (rhs == 0 || !fitsIn(lhs, INT8_MIN, INT8_MAX) || !fitsIn(rhs, INT8_MIN, INT8_MAX) || (lhs == INT8_MIN && rhs == -1))
+    {
+      return false;
+    }
+    res = op == '/' ? lhs / rhs : lhs % rhs;
+    return true;
+  default:
+    return false;
+  }
+}
+
+static std::unique_ptr<DCExpr> foldExpr(std::unique_ptr<DCExpr> expr)
+{
+  int64_t value = 0;
+  if (expr->lhs->kind != EX_NUMBER || expr->rhs->kind != EX_NUMBER || !foldBinary(expr->token.value.at(0), expr->lhs->value, expr->rhs->value, value))
+  {
+    return expr;
+  }
+
+  std::unique_ptr<DCExpr> folded = makeExpr(EX_NUMBER, expr->token);
+  folded->value = value;
+  return folded;
+}
+
+// Comparisons of literals are decided here, as long as both sides fit the i32 they are compared in
+static bool foldCondition(const DCExpr &cond, bool &res)
+{
+  if (cond.lhs->kind != EX_NUMBER || cond.rhs->kind != EX_NUMBER || !fitsIn(cond.lhs->value, INT32_MIN, INT32_MAX) || !fitsIn(cond.rhs->value, INT32_MIN, INT32_MAX))
+  {
+    return false;
+  }
+
+  int64_t lhs = cond.lhs->value;
+  int64_t rhs = cond.rhs->value;
+  std::string_view op = cond.token.value;
+  res = op == "==" ? lhs == rhs : op == "!=" ? lhs != rhs : op == "<" ? lhs < rhs : op == ">" ? lhs > rhs : op == "<=" ? lhs <= rhs : lhs >= rhs;
+  return true;
+}
+
+static bool isComparison(const Token &token)
+{
+  return token.type == TokenType::OPERATOR && (token.value == "==" || token.value == "!=" || token.value == "<" || token.value == ">" || token.value == "<=" || token.value == ">=");
+}
+
+const Token &Parser::next()
+{
+  const Token &token = lexer.next();
+  if (token.type == TokenType::END)
+  {
+    compilationError("unexcepted EOF", token.line);
+  }
+  return token;
+}
+
+const Token &Parser::peek()
+{
+  const Token &token = lexer.next();
+  lexer.rewind();
+  return token;
+}
+
+const Token &Parser::expect(TokenType type, const std::string &err)
+{
+  const Token &token = next();
+  if (token.type != type)
+  {
+    compilationError(err, token.line);
+  }
+  return token;
+}
+
+void Parser::skipStatement()
+{
+  while (lexer.last().type != TokenType::SEMICOLON && lexer.last().type != TokenType::END)
+  {
+    lexer.next();
+  }
+}
+
+DCFile Parser::parse()
+{
+  DCFile file;
+  for (Token token = lexer.next(); token.type != TokenType::END; token = lexer.next())
+  {
+    // Anything else at the top level, like string literals used as section titles, is ignored
+    if (token.type != TokenType::KEYWORD)
+    {
+      continue;
+    }
+
+    if (token.value == "extern")
+    {
+      file.externs.push_back(parseExtern(token));
+    }
+    else if (token.value == "context")
+    {
+      file.contexts.push_back(parseContext(token));
+    }
+    else
+    {
+      compilationError("Statement outside of a context", token.line);
+    }
+  }
+  return file;
+}
+
+DCExtern Parser::parseExtern(const Token &keyword)
+{
+  DCExtern ext;
+  ext.line = keyword.line;
+  ext.returnType = next().value;
+  ext.name = next();
+
+  for (Token token = next(); token.type != TokenType::SEMICOLON; token = next())
+  {
+    if (token.value == "vararg")
+    {
+      ext.vararg = true;
+    }
+    else
+    {
+      ext.params.push_back(token.value);
+    }
+  }
+  return ext;
+}
+
+DCContext Parser::parseContext(const Token &keyword)
+{
+  DCContext ctx;
+  ctx.line = keyword.line;
+
+  Token token = next();
+  if (token.type == TokenType::SEMICOLON)
+  {
+    compilationError("context; outside of a context", token.line);
+  }
+
+  if (token.value == "#nomangle")
+  {
+    ctx.nomangle = true;
+    token = next();
+  }
+  ctx.name = token;
+
+  for (token = next(); token.type != TokenType::SEMICOLON; token = next())
+  {
+    if (token.type == TokenType::ARROW)
+    {
+      ctx.returnType = next().value;
+    }
+    else if (token.type == TokenType::TYPE)
+    {
+      ctx.params.push_back({token.value, next()});
+    }
+  }
+
+  token = parseBlock(ctx.body);
+  if (token.value != "context")
+  {
+    compilationError(std::string(token.value) + (token.value == "done" ? " without while" : " without if"), token.line);
+  }
+  return ctx;
+}
+
+// Parses statements up to the keyword that ends the block (context;, elif, else, fi or done) and returns it
+Token Parser::parseBlock(std::vector<DCStmt> &body)
+{
+  while (true)
+  {
+    Token token = next();
+    if (token.type == TokenType::KEYWORD)
+    {
+      if (token.value == "context")
+      {
+        if (peek().type != TokenType::SEMICOLON)
+        {
+          compilationError("Contexts can not be nested", token.line);
+        }
+        next();
+        return token;
+      }
+
+      if (token.value == "elif" || token.value == "else" || token.value == "fi" || token.value == "done")
+      {
+        return token;
+      }
+    }
+
+    parseStatement(token, body);
+  }
+}
+
+void Parser::parseStatement(const Token &token, std::vector<DCStmt> &body)
+{
+  DCStmt stmt;
+  stmt.line = token.line;
+
+  if (token.type == TokenType::IDENTIFIER)
+  {
+    if (peek().type != TokenType::LPAREN)
+    {
+      skipStatement();
+      return;
+    }
+    next();
+
+    stmt.kind = ST_CALL;
+    stmt.name = token;
+    while (peek().type != TokenType::RPAREN)
+    {
+      stmt.args.push_back(parseExpression());
+      if (peek().type == TokenType::COMMA)
+      {
+        next();
+      }
+      else if (peek().type != TokenType::RPAREN)
+      {
+        compilationError("Expected , or ) after argument", peek().line);
+      }
+    }
+    next();
+
+    if (peek().type == TokenType::ARROW)
+    {
+      next();
+      stmt.target = expect(TokenType::IDENTIFIER, "Excepted identifier after -> in call");
+    }
+  }
+  else if (token.type != TokenType::KEYWORD)
+  {
+    return;
+  }
+  else if (token.value == "declare")
+  {
+    stmt.kind = ST_DECLARE;
+    stmt.type = next().value;
+    stmt.name = next();
+    skipStatement();
+  }
+  else if (token.value == "return")
+  {
+    stmt.kind = ST_RETURN;
+    if (peek().type != TokenType::SEMICOLON)
+    {
+      stmt.value = parseExpression();
+    }
+  }
+  else if (token.value == "assign")
+  {
+    Token name = next();
+    if (name.type == TokenType::TYPE)
+    {
+      if (name.value == "ptr")
+      {
+        stmt.ptrAssign = true;
+        name = next();
+        if (name.type != TokenType::TYPE)
+        {
+          compilationError("Explicit pointer assignment needs to have a type after ptr", name.line);
+        }
+      }
+      stmt.type = name.value;
+      name = next();
+    }
+    stmt.name = name;
+
+    Token op = next();
+    if (op.value == "=")
+    {
+      stmt.kind = ST_ASSIGN;
+      stmt.value = parseExpression();
+    }
+    else if (op.value == "->")
+    {
+      stmt.kind = ST_ADDRESS;
+      stmt.target = expect(TokenType::IDENTIFIER, "Excepted identifier after -> in assign");
+    }
+    else
+    {
+      compilationError("Unknown operator: " + std::string(op.value), op.line);
+    }
+  }
+  else if (token.value == "deref")
+  {
+    stmt.kind = ST_DEREF;
+    stmt.name = expect(TokenType::IDENTIFIER, "Excepted identifier after deref");
+    expect(TokenType::ARROW, "Excepted -> after identifier in deref");
+    stmt.target = expect(TokenType::IDENTIFIER, "Excepted identifier after -> in deref");
+  }
+  else if (token.value == "if")
+  {
+    stmt.kind = ST_IF;
+    parseIf(stmt);
+    pruneIf(stmt);
+
+    // Nothing is left of an if whose conditions are all false, an if that is always taken is just its body
+    if (stmt.arms.empty())
+    {
+      return;
+    }
+    if (stmt.arms.front().condition == nullptr)
+    {
+      for (DCStmt &armStmt : stmt.arms.front().body)
+      {
+        body.push_back(std::move(armStmt));
+      }
+      return;
+    }
+  }
+  else if (token.value == "while")
+  {
+    stmt.kind = ST_WHILE;
+    parseWhile(stmt);
+
+    // A loop that is never entered is dropped, one that is always entered runs until it returns
+    bool taken = true;
+    if (stmt.condition != nullptr && foldCondition(*stmt.condition, taken))
+    {
+      if (!taken)
+      {
+        return;
+      }
+      stmt.condition = nullptr;
+    }
+  }
+  else if (token.value == "array")
+  {
+    stmt.name = expect(TokenType::IDENTIFIER, "Excepted identifier after keyword array");
+    stmt.index = parseExpression();
+
+    Token op = next();
+    if (op.type == TokenType::ARROW)
+    {
+      stmt.kind = ST_ARRAY_LOAD;
+      stmt.target = expect(TokenType::IDENTIFIER, "Excepted identifier in array after ->");
+    }
+    else if (op.value == "=")
+    {
+      stmt.kind = ST_ARRAY_STORE;
+      stmt.value = parseExpression();
+    }
+    else
+    {
+      compilationError("Unsupported token in array after identifier", op.line);
+    }
+  }
+  else
+  {
+    compilationError("Unexpected " + std::string(token.value), token.line);
+  }
+
+  if (stmt.kind != ST_IF && stmt.kind != ST_WHILE && stmt.kind != ST_DECLARE && next().type != TokenType::SEMICOLON)
+  {
+    compilationError("Expected ; at the end of the statement", lexer.last().line);
+  }
+  body.push_back(std::move(stmt));
+}
+
+void Parser::parseIf(DCStmt &stmt)
+{
+  stmt.arms.push_back({parseCondition(), {}});
+  while (true)
+  {
+    Token token = parseBlock(stmt.arms.back().body);
+    if (token.value == "context")
+    {
+      compilationError("Missing fi before the end of the context", token.line);
+    }
+    if (token.value == "done")
+    {
+      compilationError("Missing fi before done", token.line);
+    }
+    if (token.value == "fi")
+    {
+      break;
+    }
+
+    if (stmt.arms.back().condition == nullptr)
+    {
+      compilationError(std::string(token.value) + " after else", token.line);
+    }
+    stmt.arms.push_back({token.value == "elif" ? parseCondition() : nullptr, {}});
+  }
+}
+
+// while [#unroll N] [#vectorize] condition; ... done
+void Parser::parseWhile(DCStmt &stmt)
+{
+  while (peek().value == "#unroll" || peek().value == "#vectorize")
+  {
+    if (next().value == "#vectorize")
+    {
+      stmt.vectorize = true;
+      continue;
+    }
+
+    Token count = expect(TokenType::LITERAL, "Expected a count after #unroll");
+    int64_t unroll = parseNumber(count);
+    if (unroll < 1 || unroll > INT_MAX)
+    {
+      compilationError("#unroll needs a count between 1 and " + std::to_string(INT_MAX), count.line);
+    }
+    stmt.unroll = unroll;
+  }
+
+  stmt.condition = parseCondition();
+  Token token = parseBlock(stmt.body);
+  if (token.value != "done")
+  {
+    compilationError("Missing done before " + std::string(token.value), token.line);
+  }
+}
+
+// Drops the arms that can never be taken, an arm that is always taken becomes the else. Dropped arms are never lowered,
+// so errors in them (unknown variables, bad calls) are not reported
+void Parser::pruneIf(DCStmt &stmt)
+{
+  std::vector<DCIfArm> arms;
+  for (DCIfArm &arm : stmt.arms)
+  {
+    bool taken = true;
+    if (arm.condition != nullptr && !foldCondition(*arm.condition, taken))
+    {
+      arms.push_back(std::move(arm));
+      continue;
+    }
+
+    if (taken)
+    {
+      arm.condition = nullptr;
+      arms.push_back(std::move(arm));
+      break;
+    }
+  }
+  stmt.arms = std::move(arms);
+}
+
+std::unique_ptr<DCExpr> Parser::parseCondition()
+{
+  std::unique_ptr<DCExpr> lhs = parseExpression();
+  Token op = next();
+  if (!isComparison(op))
+  {
+    compilationError("Non-operator token in IF statement", op.line);
+  }
+  std::unique_ptr<DCExpr> rhs = parseExpression();
+  return makeExpr(EX_COMPARE, op, std::move(lhs), std::move(rhs));
+}
+
+std::unique_ptr<DCExpr> Parser::parseExpression()
+{
+  std::unique_ptr<DCExpr> expr = parseTerm();
+  while (peek().value == "+" || peek().value == "-")
+  {
+    Token op = next();
+    expr = foldExpr(makeExpr(EX_BINARY, op, std::move(expr), parseTerm()));
+  }
+  return expr;
+}
+
+std::unique_ptr<DCExpr> Parser::parseTerm()
+{
+  std::unique_ptr<DCExpr> expr = parseFactor();
+  while (peek().type == TokenType::OPERATOR && (peek().value == "*" || peek().value == "/" || peek().value == "%"))
+  {
+    Token op = next();
+    expr = foldExpr(makeExpr(EX_BINARY, op, std::move(expr), parseFactor()));
+  }
+  return expr;
+}
+
+std::unique_ptr<DCExpr> Parser::parseFactor()
+{
+  Token token = next();
+  switch (token.type)
+  {
+  case TokenType::LITERAL:
+  {
+    if (token.value.at(0) == '\'')
+    {
+      return makeExpr(EX_CHAR, token);
+    }
+    std::unique_ptr<DCExpr> expr = makeExpr(EX_NUMBER, token);
+    expr->value = parseNumber(token);
+    return expr;
+  }
+  case TokenType::STRING_LITERAL:
+    return makeExpr(EX_STRING, token);
+  case TokenType::IDENTIFIER:
+    return makeExpr(EX_VARIABLE, token);
+  case TokenType::LPAREN:
+  {
+    std::unique_ptr<DCExpr> expr = parseExpression();
+    expect(TokenType::RPAREN, "Expected ) in expression");
+    return expr;
+  }
+  default:
+    compilationError("Expected a value, got " + std::string(token.value), token.line);
+    return nullptr;
+  }
+}
+
+DCFile parseFile(Lexer &lexer)
+{
+  return Parser(lexer).parse();
+}
@@ -0,0 +1,274 @@
+#include <error.hpp>
+#include <server.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+/*
+  A request is a single stream on the socket:
+
+  u32 count, count * (u32 length, bytes)   the working directory followed by argv
+  the standard input, output and error of the client travel with the first bytes as SCM_RIGHTS
+
+  The reply is the i32 exit code of the request.
+*/
+
+static const int STREAM_COUNT = 3;
+
+static bool readAll(int fd, void *data, size_t size)
+{
+  char *bytes = (char *)data;
+  while (size > 0)
+  {
+    ssize_t count = read(fd, bytes, size);
+    if (count <= 0)
+    {
+      return false;
+    }
+    bytes += count;
+    size -= count;
+  }
+  return true;
+}
+
+static bool writeAll(int fd, const void *data, size_t size)
+{
+  const char *bytes = (const char *)data;
+  while (size > 0)
+  {
+    ssize_t count = write(fd, bytes, size);
+    if (count <= 0)
+    {
+      return false;
+    }
+    bytes += count;
+    size -= count;
+  }
+  return true;
+}
+
+static sockaddr_un getAddress(const std::string &socketPath)
+{
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (socketPath.size() >= sizeof(address.sun_path))
+  {
+    fatalError("socket path is too long: " + socketPath);
+  }
+  strcpy(address.sun_path, socketPath.c_str());
+  return address;
+}
+
+static bool sendStreams(int fd, uint32_t count)
+{
+  int streams[STREAM_COUNT] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+  char control[CMSG_SPACE(sizeof(streams))] = {};
+
+  iovec data = {&count, sizeof(count)};
+  msghdr message = {};
+  message.msg_iov = &data;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  cmsghdr *header = CMSG_FIRSTHDR(&message);
+  header->cmsg_level = SOL_SOCKET;
+  header->cmsg_type = SCM_RIGHTS;
+  header->cmsg_len = CMSG_LEN(sizeof(streams));
+  memcpy(CMSG_DATA(header), streams, sizeof(streams));
+
+  return sendmsg(fd, &message, 0) == sizeof(count);
+}
+
+static bool receiveStreams(int fd, uint32_t &count, int (&streams)[STREAM_COUNT])
+{
+  char control[CMSG_SPACE(sizeof(streams))] = {};
+
+  iovec data = {&count, sizeof(count)};
+  msghdr message = {};
+  message.msg_iov = &data;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  if (recvmsg(fd, &message, MSG_WAITALL) != sizeof(count))
+  {
+    return false;
+  }
+
+  cmsghdr *header = CMSG_FIRSTHDR(&message);
+  if (header == nullptr || header->cmsg_type != SCM_RIGHTS || header->cmsg_len != CMSG_LEN(sizeof(streams)))
+  {
+    return false;
+  }
+  memcpy(streams, CMSG_DATA(header), sizeof(streams));
+  return true;
+}
+
+static int serveRequest(int connection, const DCDriver &driver)
+{
+  uint32_t count = 0;
+  int streams[STREAM_COUNT];
+  if (!receiveStreams(connection, count, streams))
+  {
+    return 1;
+  }
+
+  std::vector<std::string> fields;
+  for (uint32_t i = 0; i < count; i++)
+  {
+    uint32_t length = 0;
+    if (!readAll(connection, &length, sizeof(length)))
+    {
+      return 1;
+    }
+    std::string field(length, '\0');
+    if (!readAll(connection, field.data(), length))
+    {
+      return 1;
+    }
+    fields.push_back(field);
+  }
+
+  if (fields.size() < 2 || chdir(fields.front().c_str()) != 0)
+  {
+    return 1;
+  }
+
+  for (int i = 0; i < STREAM_COUNT; i++)
+  {
+    dup2(streams[i], i);
+    close(streams[i]);
+  }
+
+  std::vector<char *> argv;
+  for (size_t i = 1; i < fields.size(); i++)
+  {
+    argv.push_back(fields.at(i).data());
+  }
+  argv.push_back(nullptr);
+
+  int exitcode = driver(argv.size() - 1, argv.data());
+  fflush(stdout);
+  fflush(stderr);
+  return exitcode;
+}
+
+// Only a socket nobody listens on anymore is removed, anything else at the path is left alone
+static void removeStaleSocket(const std::string &socketPath, const sockaddr_un &address)
+{
+  struct stat status;
+  if (lstat(socketPath.c_str(), &status) != 0)
+  {
+    return;
+  }
+
+  if (S_ISSOCK(status.st_mode))
+  {
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    bool listening = probe >= 0 && connect(probe, (const sockaddr *)&address, sizeof(address)) == 0;
+    if (probe >= 0)
+    {
+      close(probe);
+    }
+    if (!listening)
+    {
+      unlink(socketPath.c_str());
+      return;
+    }
+  }
+  fatalError("failed to listen on " + socketPath + ": address in use");
+}
+
+int runServer(const std::string &socketPath, const DCDriver &driver)
+{
+  sockaddr_un address = getAddress(socketPath);
+  int server = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server < 0)
+  {
+    fatalError("failed to create socket: " + std::string(strerror(errno)));
+  }
+
+  removeStaleSocket(socketPath, address);
+  if (bind(server, (sockaddr *)&address, sizeof(address)) != 0 || listen(server, SOMAXCONN) != 0)
+  {
+    fatalError("failed to listen on " + socketPath + ": " + strerror(errno));
+  }
+
+  // Requests are never waited for, the kernel reaps them
+  signal(SIGCHLD, SIG_IGN);
+
+  while (true)
+  {
+    int connection = accept(server, nullptr, nullptr);
+    if (connection < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      fatalError("failed to accept a request: " + std::string(strerror(errno)));
+    }
+
+    // The child inherits the initialized targets and the loaded standard library, a crash only takes the request down
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+      close(server);
+      signal(SIGCHLD, SIG_DFL);
+      int32_t exitcode = serveRequest(connection, driver);
+      writeAll(connection, &exitcode, sizeof(exitcode));
+      _exit(0);
+    }
+    close(connection);
+  }
+}
+
+int runClient(const std::string &socketPath, int argc, char **argv)
+{
+  sockaddr_un address = getAddress(socketPath);
+  int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (connection < 0 || connect(connection, (sockaddr *)&address, sizeof(address)) != 0)
+  {
+    if (connection >= 0)
+    {
+      close(connection);
+    }
+    return -1;
+  }
+
+  char cwd[PATH_MAX];
+  if (getcwd(cwd, sizeof(cwd)) == nullptr)
+  {
+    fatalError("failed to get the working directory: " + std::string(strerror(errno)));
+  }
+
+  std::vector<std::string> fields = {cwd};
+  for (int i = 0; i < argc; i++)
+  {
+    fields.push_back(argv[i]);
+  }
+
+  bool sent = sendStreams(connection, fields.size());
+  for (std::string &field : fields)
+  {
+    uint32_t length = field.size();
+    sent = sent && writeAll(connection, &length, sizeof(length)) && writeAll(connection, field.data(), length);
+  }
+
+  int32_t exitcode = 0;
+  if (!sent || !readAll(connection, &exitcode, sizeof(exitcode)))
+  {
+    close(connection);
+    fatalError("lost the connection to the compile server at " + socketPath);
+  }
+  close(connection);
+  return exitcode;
+}
@@ -0,0 +1,127 @@
+#include <timing.hpp>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <time.h>
+#include <vector>
+
+typedef struct
+{
+  const char *name;
+  double wall;
+  double cpu;
+  int count;
+} PhaseTime;
+
+static bool enabled = false;
+static std::mutex phasesMutex;
+static std::vector<PhaseTime> phases;
+static std::atomic<uint64_t> counters[TC_COUNT];
+static std::chrono::steady_clock::time_point reportStart;
+static double reportCpuStart;
+
+static const char *counterNames[TC_COUNT] = {"tokens", "ir_instructions", "emitted_bytes"};
+
+static double threadCpuTime()
+{
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double processCpuTime()
+{
+  timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+TimeRegion::TimeRegion(const char *phase) : phase(phase)
+{
+  if (!enabled)
+  {
+    return;
+  }
+  wallStart = std::chrono::steady_clock::now();
+  cpuStart = threadCpuTime();
+}
+
+TimeRegion::~TimeRegion()
+{
+  if (!enabled)
+  {
+    return;
+  }
+
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  double cpu = threadCpuTime() - cpuStart;
+
+  std::lock_guard<std::mutex> lock(phasesMutex);
+  for (PhaseTime &time : phases)
+  {
+    if (strcmp(time.name, phase) == 0)
+    {
+      time.wall += wall;
+      time.cpu += cpu;
+      time.count++;
+      return;
+    }
+  }
+  phases.push_back({phase, wall, cpu, 1});
+}
+
+void startTimeReport(Settings &settings)
+{
+  enabled = settings.time_report;
+  reportStart = std::chrono::steady_clock::now();
+  reportCpuStart = processCpuTime();
+}
+
+void addTimeCounter(TimeCounter counter, uint64_t value)
+{
+  if (enabled)
+  {
+    counters[counter] += value;
+  }
+}
+
+void printTimeReport(Settings &settings)
+{
+  if (!enabled)
+  {
+    return;
+  }
+
+  double totalWall = std::chrono::duration<double>(std::chrono::steady_clock::now() - reportStart).count();
+  double totalCpu = processCpuTime() - reportCpuStart;
+
+  // Phases running on several workers report the sum over all of them
+  if (settings.time_report_json)
+  {
+    fprintf(stderr, "{\"version\": \"%s\", \"phases\": [", DCC_VER);
+    for (size_t i = 0; i < phases.size(); i++)
+    {
+      fprintf(stderr, "%s{\"name\": \"%s\", \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"count\": %d}", i == 0 ? "" : ", ",
+              phases.at(i).name, phases.at(i).wall * 1e3, phases.at(i).cpu * 1e3, phases.at(i).count);
+    }
+    fprintf(stderr, "], \"total\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}", totalWall * 1e3, totalCpu * 1e3);
+    for (int i = 0; i < TC_COUNT; i++)
+    {
+      fprintf(stderr, ", \"%s\": %lu", counterNames[i], (unsigned long)counters[i].load());
+    }
+    fprintf(stderr, "}\n");
+    return;
+  }
+
+  fprintf(stderr, "\x1b[1mdcc:\x1b[0m time report\n");
+  fprintf(stderr, "  %-16s %12s %12s %8s\n", "phase", "wall (ms)", "cpu (ms)", "count");
+  for (PhaseTime &time : phases)
+  {
+    fprintf(stderr, "  %-16s %12.3f %12.3f %8d\n", time.name, time.wall * 1e3, time.cpu * 1e3, time.count);
+  }
+  fprintf(stderr, "  %-16s %12.3f %12.3f\n", "total", totalWall * 1e3, totalCpu * 1e3);
+  for (int i = 0; i < TC_COUNT; i++)
+  {
+    fprintf(stderr, "  %-16s %12lu\n", counterNames[i], (unsigned long)counters[i].load());
+  }
+}